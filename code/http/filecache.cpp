@@ -0,0 +1,233 @@
+#include "filecache.h"
+using namespace std;
+
+FileCache::FileCache(): shardBudget_(0), maxEntry_(0), revalidateMs_(1000),
+    hits_(0), misses_(0), evictions_(0), invalidations_(0), compressions_(0) {}
+
+FileCache* FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(size_t budget, int revalidateMs) {
+    Clear();
+    shardBudget_ = budget / SHARD_NUM;
+    maxEntry_ = shardBudget_ / 4;
+    revalidateMs_ = revalidateMs;
+}
+
+// 粗粒度单调时钟走vDSO，不陷入内核
+int64_t FileCache::NowMs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+FileCache::Shard& FileCache::ShardOf_(const string& path) {
+    return shards_[hash<string>()(path) % SHARD_NUM];
+}
+
+// 文件不存在的条目在文件仍不存在时有效，其余条目在mtime/大小/inode都没变时有效
+bool FileCache::Fresh_(const Entry& entry) {
+    struct stat st;
+    if(stat(entry.path.c_str(), &st) < 0) {
+        return entry.ino == 0;
+    }
+    return S_ISREG(st.st_mode) && (st.st_mode & S_IROTH)
+        && st.st_size == entry.size && st.st_ino == entry.ino
+        && st.st_mtim.tv_sec == entry.mtime.tv_sec && st.st_mtim.tv_nsec == entry.mtime.tv_nsec;
+}
+
+void FileCache::Erase_(Shard& shard, Variant variant, const string& path) {
+    auto& index = shard.index[variant];
+    auto it = index.find(path);
+    if(it == index.end()) { return; }
+    shard.bytes -= (*it->second)->Charge();
+    shard.lru.erase(it->second);
+    index.erase(it);
+}
+
+shared_ptr<const FileCache::Entry> FileCache::Get(const string& path, string_view contentType,
+                                                  Variant variant, bool vary) {
+    if(shardBudget_ == 0) { return nullptr; }
+    Shard& shard = ShardOf_(path);
+    int64_t now = NowMs_();
+    shared_ptr<const Entry> entry;
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.index[variant].find(path);
+        if(it != shard.index[variant].end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);    // 移到表头
+            entry = *it->second;
+        }
+    }
+    if(entry) {
+        // 超过校验间隔时stat确认文件没变
+        if(now - entry->checkedMs.load(memory_order_relaxed) < revalidateMs_ || Fresh_(*entry)) {
+            entry->checkedMs.store(now, memory_order_relaxed);
+            hits_++;
+            return (entry->exists || entry->large) ? entry : nullptr;
+        }
+        {
+            lock_guard<mutex> locker(shard.mtx);
+            auto it = shard.index[variant].find(path);
+            if(it != shard.index[variant].end() && *it->second == entry) {
+                Erase_(shard, variant, path);
+            }
+        }
+        invalidations_++;
+        LOG_DEBUG("FileCache invalidate %s", path.c_str());
+    }
+    misses_++;
+
+    // 在锁外读文件和压缩
+    shared_ptr<Entry> loaded = Load_(path, contentType, variant, vary);
+    if(!loaded) { return nullptr; }
+    lock_guard<mutex> locker(shard.mtx);
+    Erase_(shard, variant, path);    // 其他线程可能同时加载了同一个文件
+    shard.lru.push_front(loaded);
+    shard.index[variant][path] = shard.lru.begin();
+    shard.bytes += loaded->Charge();
+    // 超出预算时从表尾淘汰，正在发送的响应仍持有条目
+    while(shard.bytes > shardBudget_ && shard.lru.size() > 1) {
+        const Entry& victim = *shard.lru.back();
+        Erase_(shard, victim.variant, string(victim.path));
+        evictions_++;
+    }
+    return (loaded->exists || loaded->large) ? loaded : nullptr;
+}
+
+shared_ptr<FileCache::Entry> FileCache::Load_(const string& path, string_view contentType,
+                                              Variant variant, bool vary) {
+    shared_ptr<Entry> entry = make_shared<Entry>();
+    entry->path = path;
+    entry->variant = variant;
+    entry->exists = false;
+    entry->large = false;
+    entry->mtime = { 0, 0 };
+    entry->size = 0;
+    entry->ino = 0;
+    entry->checkedMs.store(NowMs_(), memory_order_relaxed);
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        // 不存在的文件缓存一个空条目，其他错误不缓存
+        return errno == ENOENT ? entry : nullptr;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH)) {
+        close(fd);
+        return nullptr;
+    }
+    entry->mtime = st.st_mtim;
+    entry->size = st.st_size;
+    entry->ino = st.st_ino;
+    if(static_cast<size_t>(st.st_size) > maxEntry_) {
+        close(fd);
+        entry->large = (variant == RAW);   // 只记元数据，和不存在的条目一样靠stat校验
+        return entry;
+    }
+    if(variant == GZIP && static_cast<size_t>(st.st_size) < MIN_COMPRESS) {
+        close(fd);
+        return entry;   // 太小不压缩，记下来以后直接发原文件
+    }
+
+    entry->data.resize(st.st_size);
+    size_t done = 0;
+    while(done < entry->data.size()) {
+        ssize_t len = read(fd, &entry->data[done], entry->data.size() - done);
+        if(len < 0 && errno == EINTR) { continue; }
+        if(len <= 0) { break; }     // 读取过程中文件被截断
+        done += len;
+    }
+    close(fd);
+    if(done != entry->data.size()) { return nullptr; }
+
+    MakeETag(entry->ino, entry->size, entry->mtime, variant, entry->etag);
+    HttpDate(entry->mtime.tv_sec, entry->lastModified);
+
+    const char* encoding = nullptr;
+    if(variant == GZIP) {
+        string compressed;
+        compressions_++;
+        if(!Gzip_(entry->data, compressed) || compressed.size() >= entry->data.size()) {
+            entry->data.clear();
+            return entry;   // 压缩后没有变小
+        }
+        entry->data.swap(compressed);
+        encoding = "gzip";
+    } else if(variant == GZIP_FILE) {
+        encoding = "gzip";
+    } else if(variant == BR_FILE) {
+        encoding = "br";
+    }
+
+    entry->headers.reserve(96 + contentType.size());
+    entry->headers.append("Content-type: ").append(contentType.data(), contentType.size()).append("\r\n");
+    if(encoding) {
+        entry->headers.append("Content-encoding: ").append(encoding).append("\r\n");
+    }
+    if(vary) {
+        entry->headers.append("Vary: Accept-Encoding\r\n");
+    }
+    entry->headers.append("Content-length: ").append(to_string(entry->data.size())).append("\r\n\r\n");
+    entry->exists = true;
+    return entry;
+}
+
+// 同一文件的不同编码是不同的表示，ETag也要不同
+void FileCache::MakeETag(ino_t ino, off_t size, const struct timespec& mtime, Variant variant, string& etag) {
+    static const char* SUFFIX[VARIANT_NUM] = { "", "-gzip", "-br", "-gzip" };
+    char buf[80];
+    int len = snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx%s\"",
+                       static_cast<unsigned long>(ino), static_cast<unsigned long>(size),
+                       static_cast<unsigned long>(mtime.tv_sec) * 1000000000UL + mtime.tv_nsec, SUFFIX[variant]);
+    etag.assign(buf, len);
+}
+
+void FileCache::HttpDate(time_t t, string& date) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[40];
+    size_t len = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    date.assign(buf, len);
+}
+
+// 一次性压缩整个文件，只在加载时执行，用最高压缩级别
+bool FileCache::Gzip_(const string& in, string& out) {
+    z_stream zs = {};
+    // windowBits加16输出gzip格式
+    if(deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+FileCache::Stats FileCache::GetStats() {
+    Stats stats = { hits_, misses_, evictions_, invalidations_, compressions_, 0, 0 };
+    for(auto& shard: shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        stats.bytes += shard.bytes;
+        stats.entries += shard.lru.size();
+    }
+    return stats;
+}
+
+void FileCache::Clear() {
+    for(auto& shard: shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        for(auto& index: shard.index) {
+            index.clear();
+        }
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
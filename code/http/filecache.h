@@ -0,0 +1,127 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <fcntl.h>       // open
+#include <unistd.h>      // read, close
+#include <sys/stat.h>    // stat
+#include <time.h>        // clock_gettime, gmtime_r
+#include <zlib.h>        // gzip
+
+#include "../log/log.h"
+
+/*
+静态文件的内存缓存，按(完整路径, 变体)索引
+每个条目保存文件内容和预先生成好的实体头部(Content-type/Content-encoding/Vary/Content-length)，
+命中时在发送前不需要任何系统调用；条目以shared_ptr交给连接，淘汰后正在发送的响应仍然有效
+变体区分原始文件、预压缩的.gz/.br兄弟文件和加载时用gzip压缩一次的内容，压缩结果随条目缓存
+不存在的文件(以及不值得压缩的文件)也缓存一个空条目，避免每次请求都去探测兄弟文件
+超过单条上限的文件只缓存stat的结果，之后直接打开用sendfile发送，不用每次都open/fstat探测一遍
+按路径哈希分片，每个分片一把锁、一个LRU链表和一份内存预算
+文件修改通过stat校验：距上次校验超过revalidateMs才重新stat，发现mtime/大小/inode变化就重新加载
+*/
+class FileCache {
+public:
+    enum Variant {
+        RAW,            // 原样发送path
+        GZIP_FILE,      // path是预压缩的.gz文件
+        BR_FILE,        // path是预压缩的.br文件
+        GZIP,           // 读取path后用gzip压缩
+        VARIANT_NUM,
+    };
+
+    struct Entry {
+        std::string path;           // 完整路径
+        Variant variant;
+        bool exists;                // false表示文件不存在或不值得压缩，Get返回nullptr
+        bool large;                 // 原始文件超过单条上限，只记录下面的元数据，data和headers为空
+        std::string data;           // 文件内容(或压缩后的内容)
+        std::string headers;        // "Content-type: ...\r\n[Content-encoding/Vary]Content-length: ...\r\n\r\n"
+        std::string etag;           // 带引号的强校验值，条件请求直接比较
+        std::string lastModified;   // HTTP-date格式的修改时间
+        struct timespec mtime;      // 以下用于判断文件是否变化，文件不存在时ino为0
+        off_t size;
+        ino_t ino;
+        mutable std::atomic<int64_t> checkedMs;     // 上次校验的时间
+
+        // 占用的内存(按内容和头部估算)
+        size_t Charge() const { return data.size() + headers.size() + path.size() + sizeof(Entry); }
+    };
+
+    static const size_t MIN_COMPRESS = 256;     // 小于该大小的文件不压缩
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;         // 因预算不足被淘汰
+        uint64_t invalidations;     // 因文件变化或删除被移除
+        uint64_t compressions;      // gzip压缩的次数
+        size_t bytes;
+        size_t entries;
+    };
+
+    static FileCache* Instance();
+
+    // 由inode、大小、修改时间和变体生成ETag(带引号)，未缓存的文件也用它，保证两条路径的校验值一致
+    static void MakeETag(ino_t ino, off_t size, const struct timespec& mtime, Variant variant, std::string& etag);
+    // 格式化为HTTP-date(IMF-fixdate)，如"Sun, 06 Nov 1994 08:49:37 GMT"
+    static void HttpDate(time_t t, std::string& date);
+
+    // budget为0时关闭缓存；单个文件超过分片预算的1/4时只缓存元数据
+    void Init(size_t budget, int revalidateMs = 1000);
+
+    // 查找或加载文件的某个变体，文件不存在、不是可读的普通文件、不值得压缩或缓存关闭时返回nullptr
+    // RAW变体的文件过大时返回large为true的条目，只能用其中的元数据；其他变体过大时返回nullptr
+    // contentType和vary(是否带Vary: Accept-Encoding)只在加载时用来生成头部，同一路径和变体应保持一致
+    std::shared_ptr<const Entry> Get(const std::string& path, std::string_view contentType,
+                                     Variant variant = RAW, bool vary = false);
+
+    Stats GetStats();
+    // 清空缓存
+    void Clear();
+
+private:
+    FileCache();
+    ~FileCache() = default;
+
+    static const int SHARD_NUM = 16;
+
+    struct Shard {
+        std::mutex mtx;
+        // LRU链表，表头是最近使用的
+        std::list<std::shared_ptr<const Entry>> lru;
+        // 每个变体一张索引，查找时直接用路径，不用拼接键
+        std::unordered_map<std::string, std::list<std::shared_ptr<const Entry>>::iterator> index[VARIANT_NUM];
+        size_t bytes = 0;
+    };
+
+    static int64_t NowMs_();
+    Shard& ShardOf_(const std::string& path);
+    // 读取文件生成条目，文件不能缓存时返回nullptr
+    std::shared_ptr<Entry> Load_(const std::string& path, std::string_view contentType, Variant variant, bool vary);
+    // 重新stat，判断文件是否还和条目一致
+    static bool Fresh_(const Entry& entry);
+    // gzip压缩
+    static bool Gzip_(const std::string& in, std::string& out);
+    // 从分片中移除(调用方持有锁)
+    void Erase_(Shard& shard, Variant variant, const std::string& path);
+
+    Shard shards_[SHARD_NUM];
+    std::atomic<size_t> shardBudget_;
+    std::atomic<size_t> maxEntry_;
+    std::atomic<int> revalidateMs_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> evictions_;
+    std::atomic<uint64_t> invalidations_;
+    std::atomic<uint64_t> compressions_;
+};
+
+#endif //FILE_CACHE_H
@@ -9,6 +9,8 @@ HttpConn::HttpConn() {
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    iovIdx_ = toWrite_ = fileIdx_ = 0;
+    isKeepAlive_ = false;
 };
 
 HttpConn::~HttpConn() { 
@@ -24,18 +26,22 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     // 保存客户端socket描述符
     fd_ = fd;
     // 清空写缓冲区
-    writeBuff_.RetrieveAll();
+    ClearWrite_();
+    isKeepAlive_ = false;
     // 清空读缓冲区
     readBuff_.RetrieveAll();
+    // 连接对象会被复用，丢弃上一个连接的解析进度
+    request_.Init();
     // 设置连接状态为false
     isClose_ = false;
     // 打印客户端连接信息
-    LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
+    LOG_RATE(1, CONN_LOG_PER_SEC, "Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
     // 取消文件映射
     response_.UnmapFile();
+    ClearWrite_();
     // 如果isClose_为false，则将isClose_置为true，并将用户数减一
     if(isClose_ == false){
         isClose_ = true; 
@@ -43,7 +49,7 @@ void HttpConn::Close() {
         // 关闭文件描述符
         close(fd_);
         // 记录日志
-        LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
+        LOG_RATE(1, CONN_LOG_PER_SEC, "Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
     }
 }
 
@@ -79,62 +85,256 @@ ssize_t HttpConn::read(int* saveErrno) {
     return len;
 }
 
-bool HttpConn::process() {                  //从readbuff_中解析请求，生成响应报文，放入writeBuff_中
-    request_.Init();
-    if(readBuff_.ReadableBytes() <= 0) {
+// 从readbuff_中解析请求，生成响应报文，放入writeBuff_中
+// 缓冲区中有多个完整请求(流水线)时逐个处理，响应按顺序排队，最后合成一个iovec列表一次发送
+// 一个完整请求都没有时返回false，保留解析进度，由调用方继续监听读事件
+bool HttpConn::process() {
+    if(toWrite_ > 0) {
+        return true;    // 上一批响应还没发完
+    }
+    // 同一批流水线请求的服务时间都从这里算起
+    bool accessOn = AccessLog::Instance()->IsOpen();
+    int64_t start = accessOn ? AccessLog::NowNs() : 0;
+    int count = 0;
+    while(count < MAX_PIPELINE) {
+        // 上一个请求已经响应过，开始解析新的请求
+        if(request_.IsFinish()) {
+            request_.Init();
+        }
+        if(readBuff_.ReadableBytes() <= 0) {
+            break;
+        }
+        HttpRequest::PARSE_RESULT ret = request_.parse(readBuff_);
+        if(ret == HttpRequest::NEED_MORE) {
+            break;
+        }
+        size_t before = writeBuff_.ReadableBytes();
+        if(ret == HttpRequest::COMPLETE) {    // 解析成功
+            LOG_DEBUG("%s", request_.path().c_str());
+            isKeepAlive_ = request_.IsKeepAlive();
+            response_.Init(srcDir, request_.path(), isKeepAlive_, 200,
+                           request_.GetHeader(HttpHeader::ACCEPT_ENCODING));
+            if(request_.method() == "GET") {
+                response_.SetConditional(request_.GetHeader(HttpHeader::IF_NONE_MATCH),
+                                         request_.GetHeader(HttpHeader::IF_MODIFIED_SINCE));
+                response_.SetRange(request_.GetHeader(HttpHeader::RANGE),
+                                   request_.GetHeader(HttpHeader::IF_RANGE));
+            }
+        } else {
+            isKeepAlive_ = false;
+            response_.Init(srcDir, request_.path(), false, 400);
+        }
+        response_.MakeResponse(writeBuff_); // 生成响应报文放入writeBuff_中
+
+        // 响应头，writeBuff_在追加过程中可能扩容，地址等全部追加完再填
+        size_t headLen = writeBuff_.ReadableBytes() - before;
+        size_t bytes = headLen;
+        bool hasFile = response_.FileLen() > 0 && (response_.File() || response_.FileFd() >= 0);
+        if(hasFile && !response_.Slices().empty()) {
+            // 206：头部(或multipart分隔)与文件片段交替，最后是结束分隔
+            const auto& slices = response_.Slices();
+            for(size_t i = 0; i < slices.size(); i++) {
+                PushHead_(slices[i].textBefore);
+                headLen -= slices[i].textBefore;
+                PushFile_(slices[i].offset, slices[i].len, i + 1 == slices.size());
+                bytes += slices[i].len;
+            }
+            PushHead_(headLen);
+        } else {
+            PushHead_(headLen);
+            if(hasFile) {
+                PushFile_(0, response_.FileLen(), true);
+                bytes += response_.FileLen();
+            }
+        }
+        if(accessOn && AccessLog::Instance()->Sample(response_.Code())) {
+            access_.emplace_back();
+            AccessRecord& rec = access_.back();
+            rec.Fill(start, addr_.sin_addr.s_addr, request_.method(), request_.path(), request_.version(),
+                     request_.GetHeader(HttpHeader::REFERER), request_.GetHeader(HttpHeader::USER_AGENT));
+            rec.status = static_cast<uint16_t>(response_.Code());
+            rec.bytes = response_.BodyLen();
+            rec.sent = bytes;
+        }
+        count++;
+        if(!isKeepAlive_) {
+            break;      // 发完这个响应就关闭连接，后面的请求不再处理
+        }
+    }
+    if(count == 0) {
         return false;
     }
-    else if(request_.parse(readBuff_)) {    // 解析成功
-        LOG_DEBUG("%s", request_.path().c_str());
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
-    } else {
-        response_.Init(srcDir, request_.path(), false, 400);
+    // 文件块按顺序排列，跟着下标一起往后走，不用为每一块查找
+    char* head = const_cast<char*>(writeBuff_.Peek());
+    size_t file = fileIdx_;
+    for(size_t i = 0; i < iov_.size(); i++) {
+        if(file < files_.size() && files_[file].idx == i) {
+            file++;
+        } else if(iov_[i].iov_base == nullptr) {
+            iov_[i].iov_base = head;
+            head += iov_[i].iov_len;
+        }
+        toWrite_ += iov_[i].iov_len;
     }
+    LOG_DEBUG("responses:%d, iovcnt:%d, to write %d", count, (int)iov_.size(), ToWriteBytes());
+    return true;
+}
 
-    response_.MakeResponse(writeBuff_); // 生成响应报文放入writeBuff_中
-    // 响应头
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek()); // 将writeBuff_中的数据指针赋值给iov_[0].iov_base
-    iov_[0].iov_len = writeBuff_.ReadableBytes(); // 将writeBuff_中可读字节数赋值给iov_[0].iov_len
-    iovCnt_ = 1; // iovCnt_置为1
-
-    // 文件
-    if(response_.FileLen() > 0  && response_.File()) {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();   
-        iovCnt_ = 2;
+
+void HttpConn::PushHead_(size_t len) {
+    if(len == 0) {
+        return;
+    }
+    // 最后一块是文件块时它一定是files_的最后一个
+    bool lastIsFile = !files_.empty() && files_.back().idx + 1 == iov_.size();
+    if(!iov_.empty() && iov_.back().iov_base == nullptr && !lastIsFile) {
+        iov_.back().iov_len += len;   // 与上一个响应的头部相邻，合并成一块
+    } else {
+        iov_.push_back({ nullptr, len });
     }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
-    return true;
 }
 
+// 映射和缓存的内容直接指向片段，大文件改用sendfile从offset开始发送
+// last表示这是该响应的最后一个片段，由它接管映射、缓存条目或文件描述符
+void HttpConn::PushFile_(off_t offset, size_t len, bool last) {
+    if(response_.File()) {
+        iov_.push_back({ response_.File() + offset, len });
+        if(!last) {
+            return;
+        }
+        if(response_.CachedFile()) {
+            cached_.push_back(response_.CachedFile());  // 缓存条目被淘汰后内容仍然有效
+        } else {
+            maps_.push_back({ response_.File(), response_.FileLen() });
+            response_.ReleaseFile();
+        }
+    } else {
+        // 同一个描述符的多个片段只由最后一个负责关闭
+        int fd = last ? response_.ReleaseFd() : response_.FileFd();
+        files_.push_back({ iov_.size(), fd, offset, last });
+        iov_.push_back({ nullptr, len });
+    }
+}
 
-// 主要采用writev连续写函数
+// 主要采用writev连续写函数，一次写出所有排队的响应
+// 遇到大文件块时改用sendfile，文件偏移记录在FileSeg中，EAGAIN后下次从断点继续
 ssize_t HttpConn::write(int* saveErrno) {           
-    /* write()将writeBuff_中的内容写入fd */
+    /* write()将iov_中的内容写入fd */
     ssize_t len = -1;
     do {
-        len = writev(fd_, iov_, iovCnt_);   // 将iov(writeBuff_)的内容写到fd中
+        if(fileIdx_ < files_.size() && files_[fileIdx_].idx == iovIdx_) {
+            FileSeg& file = files_[fileIdx_];
+            struct iovec& iov = iov_[iovIdx_];
+            len = sendfile(fd_, file.fd, &file.offset, iov.iov_len);
+            if(len < 0) {
+                *saveErrno = errno;
+                break;
+            }
+            if(len == 0) {
+                // 文件在发送途中被截断，errno是上一次调用留下的(常为EAGAIN)，不能沿用，否则会一直等写事件
+                *saveErrno = EIO;
+                len = -1;
+                break;
+            }
+            toWrite_ -= len;
+            iov.iov_len -= len;
+            if(iov.iov_len == 0) {
+                if(file.owner) { close(file.fd); }
+                file.fd = -1;
+                fileIdx_++;
+                iovIdx_++;
+            }
+            if(toWrite_ == 0) {     /* 传输结束 */
+                ClearWrite_();
+                break;
+            }
+            continue;
+        }
+        // writev只写到下一个文件块之前
+        size_t stop = fileIdx_ < files_.size() ? files_[fileIdx_].idx : iov_.size();
+        int cnt = static_cast<int>(std::min<size_t>(stop - iovIdx_, IOV_MAX));
+        len = writev(fd_, iov_.data() + iovIdx_, cnt);   // 将iov的内容写到fd中
         if(len <= 0) {
             *saveErrno = errno;
             break;
         }
-        if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
-        else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len) {
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
-        }
-        else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; 
-            iov_[0].iov_len -= len; 
-            writeBuff_.Retrieve(len);
+        Advance_(len);
+        if(toWrite_ == 0) {     /* 传输结束 */
+            ClearWrite_();
+            break;
         }
     } while(isET || ToWriteBytes() > 10240);
     return len;
 }
 
+void HttpConn::Advance_(size_t len) {
+    toWrite_ -= len;
+    size_t left = len;
+    while(left > 0) {
+        struct iovec& iov = iov_[iovIdx_];
+        if(left >= iov.iov_len) {
+            left -= iov.iov_len;
+            iov.iov_len = 0;
+            iovIdx_++;
+        } else {
+            iov.iov_base = (uint8_t*)iov.iov_base + left;
+            iov.iov_len -= left;
+            left = 0;
+        }
+    }
+}
+
+void HttpConn::ReadDone(const char* data, size_t len) {
+    readBuff_.Append(data, len);
+}
+
+int HttpConn::WriteIov(const struct iovec** iov) const {
+    size_t stop = fileIdx_ < files_.size() ? files_[fileIdx_].idx : iov_.size();
+    *iov = iov_.data() + iovIdx_;
+    return static_cast<int>(std::min<size_t>(stop - iovIdx_, IOV_MAX));
+}
 
+void HttpConn::WriteDone(size_t len) {
+    assert(len <= toWrite_);
+    Advance_(len);
+    if(toWrite_ == 0) {
+        ClearWrite_();
+    }
+}
+
+// 响应按顺序发送，连接中途关闭时没发出的字节从最后的记录往前扣(有未抽中的响应时只是近似)
+// 正文在每个响应的末尾，所以一个响应没发出的部分先从正文里扣
+void HttpConn::FinishAccess_() {
+    if(access_.empty()) {
+        return;
+    }
+    int64_t now = AccessLog::NowNs();
+    size_t unsent = toWrite_;
+    for(size_t i = access_.size(); i-- > 0 && unsent > 0;) {
+        size_t n = std::min<size_t>(access_[i].sent, unsent);
+        access_[i].sent -= n;
+        access_[i].bytes -= std::min<size_t>(access_[i].bytes, n);
+        unsent -= n;
+    }
+    for(auto& rec: access_) {
+        rec.durUs = static_cast<uint32_t>((now - rec.timeNs) / 1000);
+        AccessLog::Instance()->Append(rec);
+    }
+    access_.clear();
+}
 
+void HttpConn::ClearWrite_() {
+    FinishAccess_();
+    for(auto& m: maps_) {
+        munmap(m.iov_base, m.iov_len);
+    }
+    maps_.clear();
+    cached_.clear();
+    for(auto& file: files_) {
+        if(file.fd >= 0 && file.owner) { close(file.fd); }
+    }
+    files_.clear();
+    iov_.clear();
+    iovIdx_ = toWrite_ = fileIdx_ = 0;
+    writeBuff_.RetrieveAll();
+}
@@ -3,11 +3,17 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>     // readv/writev
+#include <sys/mman.h>    // munmap
+#include <sys/sendfile.h> // sendfile
+#include <limits.h>      // IOV_MAX
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
 #include <errno.h>      
+#include <vector>
+#include <algorithm>
 
 #include "../log/log.h"
+#include "../log/accesslog.h"
 #include "../buffer/buffer.h"
 #include "httprequest.h"
 #include "httpresponse.h"
@@ -25,6 +31,12 @@ public:
     ssize_t read(int* saveErrno);
     // 向socket写入数据
     ssize_t write(int* saveErrno);
+    // 事件后端以完成方式收到了len字节数据，追加到读缓冲区
+    void ReadDone(const char* data, size_t len);
+    // 交给事件后端发送的iovec：到下一个sendfile块为止，下一块就是文件时返回0，由write()发送
+    int WriteIov(const struct iovec** iov) const;
+    // 事件后端以完成方式发出了len字节
+    void WriteDone(size_t len);
     // 关闭连接
     void Close();
     // 获取socket的fd
@@ -40,14 +52,19 @@ public:
 
     // 写的总长度
     int ToWriteBytes() { 
-        return iov_[0].iov_len + iov_[1].iov_len; 
+        return toWrite_; 
     }
 
-    // 是否长连接
+    // 是否长连接(以最后一个排队的响应为准)
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return isKeepAlive_;
     }
 
+    // 一次读事件最多处理的流水线请求数，剩下的在响应发完后继续处理
+    static const int MAX_PIPELINE = 32;
+    // 连接建立、断开日志每个调用点每秒最多记录的条数，其余只汇总条数
+    static const int CONN_LOG_PER_SEC = 20;
+
     // 是否边缘触发
     static bool isET;
     // 资源文件路径
@@ -63,9 +80,34 @@ private:
     // 定义一个布尔变量isClose_
     bool isClose_;
     
-    int iovCnt_;  //io向量的数量
-    // 定义一个iovec数组变量iov_
-    struct iovec iov_[2];       //iovec用于描述一个缓冲区（buffer）的地址和长度
+    // 清空待发送的数据并解除文件映射
+    void ClearWrite_();
+    // 跳过已经写出的len字节，最后一块可能只写了一部分
+    void Advance_(size_t len);
+    // 提交排队响应的访问记录
+    void FinishAccess_();
+    // 追加len字节的头部块(地址在process最后统一填写)
+    void PushHead_(size_t len);
+    // 追加当前响应文件的一个片段
+    void PushFile_(off_t offset, size_t len, bool last);
+
+    // 待发送的数据块，依次是各个响应的头部(在writeBuff_中)和文件，用一次writev发出
+    std::vector<struct iovec> iov_;
+    size_t iovIdx_;             // 第一个还没发完的块
+    size_t toWrite_;            // 剩余待发送的字节数
+    std::vector<struct iovec> maps_;  // 排队响应的文件映射，全部发送完后解除
+    std::vector<std::shared_ptr<const FileCache::Entry>> cached_;   // 排队响应引用的缓存条目
+    // 用sendfile发送的文件块：在iov_中占第idx块(iov_len为剩余长度)，按顺序排列
+    struct FileSeg {
+        size_t idx;
+        int fd;
+        off_t offset;       // 下次发送的文件偏移，部分发送后由sendfile更新
+        bool owner;         // 多段范围共用一个描述符时只有最后一段负责关闭
+    };
+    std::vector<FileSeg> files_;
+    size_t fileIdx_;            // 下一个还没发完的文件块
+    bool isKeepAlive_;          // 最后一个响应是否保持连接
+    std::vector<AccessRecord> access_;  // 排队响应中被抽中的访问记录，发完后提交
     
     // 读缓冲区
     Buffer readBuff_; 
@@ -0,0 +1,117 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <array>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+/*
+常用请求头的编号表
+头部名按RFC 7230不区分大小写，用编译期找到的种子构造一个完美哈希：
+每个已知头部落在不同的槽位上，查找只需一次哈希、一次长度比较和一次忽略大小写的比较
+*/
+class HttpHeader {
+public:
+    enum ID : uint8_t {
+        CONNECTION,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        HOST,
+        ACCEPT,
+        ACCEPT_ENCODING,
+        ACCEPT_LANGUAGE,
+        IF_NONE_MATCH,
+        IF_MODIFIED_SINCE,
+        IF_RANGE,
+        RANGE,
+        COOKIE,
+        USER_AGENT,
+        REFERER,
+        TRANSFER_ENCODING,
+        CACHE_CONTROL,
+        UPGRADE,
+        EXPECT,
+        ORIGIN,
+        AUTHORIZATION,
+        COUNT,
+        UNKNOWN = COUNT,
+    };
+
+    static constexpr std::string_view NAMES[COUNT] = {
+        "Connection", "Content-Length", "Content-Type", "Host",
+        "Accept", "Accept-Encoding", "Accept-Language",
+        "If-None-Match", "If-Modified-Since", "If-Range", "Range",
+        "Cookie", "User-Agent", "Referer", "Transfer-Encoding",
+        "Cache-Control", "Upgrade", "Expect", "Origin", "Authorization",
+    };
+
+    // 头部名查编号，不是已知头部时返回UNKNOWN
+    static constexpr ID Lookup(std::string_view name) {
+        ID id = static_cast<ID>(TABLE[Slot_(name, SEED)]);
+        if(id != UNKNOWN && EqualsIgnoreCase(NAMES[id], name)) {
+            return id;
+        }
+        return UNKNOWN;
+    }
+
+    static constexpr std::string_view Name(ID id) {
+        return id < COUNT ? NAMES[id] : std::string_view();
+    }
+
+    // 只对字母转小写，头部名都是token字符，不受影响
+    static constexpr char Lower(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+    }
+
+    static constexpr bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+        if(a.size() != b.size()) { return false; }
+        for(size_t i = 0; i < a.size(); i++) {
+            if(Lower(a[i]) != Lower(b[i])) { return false; }
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t TABLE_SIZE = 64;    // 2的幂，须大于COUNT
+
+    // 忽略大小写的FNV-1a
+    static constexpr size_t Slot_(std::string_view name, uint32_t seed) {
+        uint32_t h = seed ^ static_cast<uint32_t>(name.size());
+        for(char c: name) {
+            h = (h ^ static_cast<uint8_t>(Lower(c))) * 16777619u;
+        }
+        return (h ^ (h >> 16)) & (TABLE_SIZE - 1);
+    }
+
+    // 从1开始找第一个让所有已知头部都不冲突的种子，找不到时编译期求值失败(编译报错)
+    static constexpr uint32_t FindSeed_() {
+        for(uint32_t seed = 1; seed < 100000; seed++) {
+            bool used[TABLE_SIZE] = {};
+            bool ok = true;
+            for(size_t i = 0; i < COUNT && ok; i++) {
+                size_t slot = Slot_(NAMES[i], seed);
+                ok = !used[slot];
+                used[slot] = true;
+            }
+            if(ok) { return seed; }
+        }
+        throw "no perfect hash seed for the known header set";
+    }
+
+    static constexpr std::array<uint8_t, TABLE_SIZE> BuildTable_(uint32_t seed) {
+        std::array<uint8_t, TABLE_SIZE> table = {};
+        for(size_t i = 0; i < TABLE_SIZE; i++) { table[i] = UNKNOWN; }
+        for(size_t i = 0; i < COUNT; i++) { table[Slot_(NAMES[i], seed)] = static_cast<uint8_t>(i); }
+        return table;
+    }
+
+    // 类定义完整后才能在常量表达式里调用上面的函数，所以放到类外定义
+    static const uint32_t SEED;
+    static const std::array<uint8_t, TABLE_SIZE> TABLE;
+};
+
+inline constexpr uint32_t HttpHeader::SEED = HttpHeader::FindSeed_();
+inline constexpr std::array<uint8_t, HttpHeader::TABLE_SIZE> HttpHeader::TABLE = HttpHeader::BuildTable_(HttpHeader::SEED);
+
+#endif //HTTP_HEADER_H
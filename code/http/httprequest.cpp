@@ -15,34 +15,63 @@ void HttpRequest::Init() {
     method_ = path_ = version_ = body_ = "";
     // 设置请求状态
     state_ = REQUEST_LINE;
-    // 清空请求头
-    header_.clear();
+    contentLen_ = scanned_ = headerBytes_ = headerCnt_ = 0;
+    // 清空请求头(保留字符串的容量)
+    for(size_t i = 0; i < HttpHeader::COUNT; i++) {
+        if(present_ & (1u << i)) { known_[i].clear(); }
+    }
+    present_ = 0;
+    othersCnt_ = 0;
     // 清空请求体
     post_.clear();
 }
 
 bool HttpRequest::IsKeepAlive() const {
-    //如果header_中"Connection"的个数为1
-   if(header_.count("Connection") == 1) {
-        //如果header_中"Connection"的值为"keep-alive"且version_为"1.1"
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+    //如果有"Connection"头部
+    if(HasHeader(HttpHeader::CONNECTION)) {
+        //如果"Connection"的值为"keep-alive"(不区分大小写)且version_为"1.1"
+        return HttpHeader::EqualsIgnoreCase(known_[HttpHeader::CONNECTION], "keep-alive") && version_ == "1.1";
     }
     //否则返回false
     return false;
 }
 
 // 解析处理
-bool HttpRequest::parse(Buffer& buff) {
-    const char CRLF[] = "\r\n";      // 行结束符标志(回车换行)
-    if(buff.ReadableBytes() <= 0) { // 没有可读的字节
-        return false;
-    }
-    // 读取数据
-    while(buff.ReadableBytes() && state_ != FINISH) {
-        // 从buff中的读指针开始到读指针结束，这块区域是未读取的数据并去处"\r\n"，返回有效数据得行末指针
-        const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);      //获取一行的末尾位置指针
-        // 转化为string类型
-        std::string line(buff.Peek(), lineEnd);
+// 手写状态机，逐行扫描读缓冲区，每一行以string_view的形式交给各状态处理，不产生行拷贝
+// 只取走完整的行，不完整的行留在缓冲区里，下次读到更多数据后从上次扫描到的位置继续
+HttpRequest::PARSE_RESULT HttpRequest::parse(Buffer& buff) {
+    while(state_ != FINISH) {
+        const char* begin = buff.Peek();
+        const char* end = buff.BeginWriteConst();
+        if(state_ == BODY) {
+            // 请求体按Content-Length收齐后再处理
+            if(static_cast<size_t>(end - begin) < contentLen_) {
+                return NEED_MORE;
+            }
+            ParseBody_(std::string_view(begin, contentLen_));
+            buff.Retrieve(contentLen_);
+            break;
+        }
+        // 上次扫描到的最后一个字节可能是'\r'，回退一个字节再找
+        const char* from = begin + (scanned_ > 0 ? scanned_ - 1 : 0);
+        const char* lineEnd = HttpScan::FindCRLF(from, end);
+        if(lineEnd == end) {
+            scanned_ = end - begin;
+            if(scanned_ > MAX_LINE_LEN || headerBytes_ + scanned_ > MAX_HEADER_BYTES) {
+                LOG_ERROR("Line too long");
+                return BAD_REQUEST;
+            }
+            return NEED_MORE;   // 行不完整，等待更多数据
+        }
+        scanned_ = 0;
+        // 一次读到的完整行同样受长度限制，头部总量也有上限，否则重复的头部可以让内存无限增长
+        size_t lineLen = lineEnd - begin;
+        headerBytes_ += lineLen + 2;
+        if(lineLen > MAX_LINE_LEN || headerBytes_ > MAX_HEADER_BYTES) {
+            LOG_ERROR("Header too large");
+            return BAD_REQUEST;
+        }
+        std::string_view line(begin, lineLen);
         switch(state_)
         {
         /*
@@ -50,27 +79,22 @@ bool HttpRequest::parse(Buffer& buff) {
         */
         case REQUEST_LINE:      
             if(!ParseRequestLine_(line)) {
-                return false;
+                return BAD_REQUEST;
             }
             ParsePath_();   // 解析路径
             break;    
         case HEADERS:
-            ParseHeader_(line);
-            if(buff.ReadableBytes() <= 2) { 
-                state_ = FINISH;
+            if(!ParseHeader_(line)) {
+                return BAD_REQUEST;
             }
             break;
-        case BODY:
-            ParseBody_(line);
-            break;
         default:
             break;
         }
-        if(lineEnd == buff.BeginWrite()) { break; } // 读完了
         buff.RetrieveUntil(lineEnd + 2);        // 跳过回车换行
     }
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
+    return COMPLETE;
 }
 
 // 解析路径
@@ -90,41 +114,114 @@ void HttpRequest::ParsePath_() {
     }
 }
 
-bool HttpRequest::ParseRequestLine_(const string& line) {
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$"); 
-    smatch subMatch;
-    // 在匹配规则中，以括号()的方式来划分组别 一共三个括号 [0]表示整体
-    if(regex_match(line, subMatch, patten)) {      // 匹配指定字符串整体是否符合
-        method_ = subMatch[1];
-        path_ = subMatch[2];
-        version_ = subMatch[3];
-        state_ = HEADERS;   // 状态转换为下一个状态
-        return true;
+// 请求行格式: 方法 SP 路径 SP HTTP/版本，三段都不能含空格和控制字符
+bool HttpRequest::ParseRequestLine_(string_view line) {
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    if(HttpScan::FindInvalid(begin, end) == end) {
+        const char* sp1 = HttpScan::FindChar(begin, end, ' ');
+        const char* sp2 = (sp1 == end) ? end : HttpScan::FindChar(sp1 + 1, end, ' ');
+        if(sp2 != end) {
+            string_view proto(sp2 + 1, end - sp2 - 1);
+            if(proto.size() >= 5 && proto.compare(0, 5, "HTTP/") == 0
+                    && proto.find(' ') == string_view::npos) {
+                method_.assign(begin, sp1 - begin);
+                path_.assign(sp1 + 1, sp2 - sp1 - 1);
+                version_.assign(proto.data() + 5, proto.size() - 5);
+                state_ = HEADERS;   // 状态转换为下一个状态
+                return true;
+            }
+        }
     }
     LOG_ERROR("RequestLine Error");
     return false;
 }
 
-void HttpRequest::ParseHeader_(const string& line) {
-    // 利用正则表达式解析头部以冒号分割的键值对信息
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;//存放匹配结果
-    // 如果当前行line匹配正则表达式patten
-    if(regex_match(line, subMatch, patten)) {
-        // 将解析出来的头部信息存入map中
-        header_[subMatch[1]] = subMatch[2];
+// 头部格式: 名字 ":" [空格] 值，空行表示头部结束
+// 不含冒号的行、出现除HT以外的控制字符时视为非法请求
+bool HttpRequest::ParseHeader_(string_view line) {
+    if(line.empty()) {
+        return ParseHeaderEnd_();
     }
-    else {
-        // 如果解析失败，则状态转换为下一个状态
-        state_ = BODY;  // 状态转换为下一个状态
+    if(++headerCnt_ > MAX_HEADER_CNT) {
+        LOG_ERROR("Too many headers");
+        return false;
+    }
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    const char* colon = HttpScan::FindChar(begin, end, ':');
+    if(colon == end || HttpScan::FindInvalid(begin, end) != end) {
+        LOG_ERROR("Header Error");
+        return false;
     }
+    const char* value = colon + 1;
+    if(value < end && *value == ' ') {
+        value++;
+    }
+    string_view name(begin, colon - begin);
+    HttpHeader::ID id = HttpHeader::Lookup(name);
+    if(id != HttpHeader::UNKNOWN) {
+        string& field = known_[id];
+        if(present_ & (1u << id)) {
+            // 重复的头部按RFC 7230合并成逗号分隔的列表(Cookie用分号)
+            field.append(id == HttpHeader::COOKIE ? "; " : ", ");
+            field.append(value, end - value);
+        } else {
+            field.assign(value, end - value);
+            present_ |= 1u << id;
+        }
+    } else {
+        if(othersCnt_ == others_.size()) {
+            others_.emplace_back();
+        }
+        others_[othersCnt_].first.assign(name.data(), name.size());
+        others_[othersCnt_].second.assign(value, end - value);
+        othersCnt_++;
+    }
+    return true;
 }
 
-void HttpRequest::ParseBody_(const string& line) {
-    body_ = line;
+string_view HttpRequest::GetHeader(string_view name) const {
+    HttpHeader::ID id = HttpHeader::Lookup(name);
+    if(id != HttpHeader::UNKNOWN) {
+        return known_[id];
+    }
+    for(size_t i = 0; i < othersCnt_; i++) {
+        if(HttpHeader::EqualsIgnoreCase(others_[i].first, name)) {
+            return others_[i].second;
+        }
+    }
+    return string_view();
+}
+
+// 有Content-Length时转入BODY状态接收请求体，否则请求到此结束
+// 不支持分块传输(Transfer-Encoding)
+bool HttpRequest::ParseHeaderEnd_() {
+    contentLen_ = 0;
+    if(HasHeader(HttpHeader::TRANSFER_ENCODING)) {
+        LOG_ERROR("Transfer-Encoding not supported");
+        return false;
+    }
+    if(HasHeader(HttpHeader::CONTENT_LENGTH)) {
+        const string& value = known_[HttpHeader::CONTENT_LENGTH];
+        char* numEnd = nullptr;
+        unsigned long long len = strtoull(value.c_str(), &numEnd, 10);
+        if(value.empty() || !isdigit(static_cast<unsigned char>(value[0])) || *numEnd != '\0'
+                || len > MAX_BODY_LEN) {
+            LOG_ERROR("Content-Length Error");
+            return false;
+        }
+        contentLen_ = len;
+    }
+    state_ = contentLen_ > 0 ? BODY : FINISH;
+    return true;
+}
+
+void HttpRequest::ParseBody_(string_view line) {
+    body_.assign(line.data(), line.size());
     ParsePost_();
     state_ = FINISH;    // 状态转换为下一个状态
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+    LOG_DEBUG("Body:%s, len:%d", body_.c_str(), body_.size());
 }
 
 // 16进制转化为10进制
@@ -136,7 +233,7 @@ int HttpRequest::ConverHex(char ch) {
 
 // 处理post请求
 void HttpRequest::ParsePost_() {
-    if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
+    if(method_ == "POST" && known_[HttpHeader::CONTENT_TYPE] == "application/x-www-form-urlencoded") {
         ParseFromUrlencoded_();     // POST请求体示例
         if(DEFAULT_HTML_TAG.count(path_)) { // 如果是登录/注册的path            查找_path的值是否在DEFAULT_HTML_TAG中
             int tag = DEFAULT_HTML_TAG.find(path_)->second; 
@@ -194,70 +291,47 @@ void HttpRequest::ParseFromUrlencoded_() {
     }
 }
 
+// 启动时登记，连接池在每个连接上各准备一次，之后每次验证只传参数
+const int HttpRequest::SELECT_USER_STMT =
+    SqlConnPool::Instance()->RegisterStmt("SELECT password FROM user WHERE username = ? LIMIT 1");
+const int HttpRequest::INSERT_USER_STMT =
+    SqlConnPool::Instance()->RegisterStmt("INSERT INTO user(username, password) VALUES(?, ?)");
+
 bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin) {
     // 用户名或密码为空，返回false
     if(name == "" || pwd == "") { return false; }
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+    LOG_DEBUG("Verify name:%s", name.c_str());     // 不记录密码
     MYSQL* sql;
-    // 从连接池中获取一个连接
-    SqlConnRAII(&sql,  SqlConnPool::Instance());
-    assert(sql);
-    
-    bool flag = false;
-    unsigned int j = 0;
-    char order[256] = { 0 };
-    MYSQL_FIELD *fields = nullptr;
-    MYSQL_RES *res = nullptr;
-    
-    // 如果是注册行为，默认值为true
-    if(!isLogin) { flag = true; }
-    /* 查询用户及密码 */
-    // 查询用户名对应的密码
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
+    // 从连接池中获取一个连接，函数返回时放回
+    SqlConnRAII conn(&sql, SqlConnPool::Instance());
+    if(!sql) { return false; }
 
-    if(mysql_query(sql, order)) { 
-        mysql_free_result(res);
-        return false; 
+    /* 查询用户及密码 */
+    SqlStmt* select = SqlConnPool::Instance()->GetStmt(sql, SELECT_USER_STMT);
+    if(!select || !select->Execute({ name })) {
+        return false;
     }
-    // 获取查询结果
-    res = mysql_store_result(sql);
-    j = mysql_num_fields(res);
-    fields = mysql_fetch_fields(res);
-
-    while(MYSQL_ROW row = mysql_fetch_row(res)) {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]);
-        /* 注册行为 且 用户名未被使用*/
+    bool exists = false;
+    bool flag = false;
+    vector<string> row;
+    while(select->Fetch(row)) {
+        exists = true;
         if(isLogin) {
-            if(pwd == password) { flag = true; }
-            else {
-                flag = false;
-                LOG_INFO("pwd error!");
-            }
-        } 
-        else { 
-            flag = false; 
+            flag = (pwd == row[0]);
+            if(!flag) { LOG_INFO("pwd error!"); }
+        } else {
             LOG_INFO("user used!");
         }
     }
-    mysql_free_result(res);
 
     /* 注册行为 且 用户名未被使用*/
-    if(!isLogin && flag == true) {
+    if(!isLogin && !exists) {
         LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        // 插入用户名和密码
-        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "%s", order);
-        if(mysql_query(sql, order)) { 
-            LOG_DEBUG( "Insert error!");
-            flag = false; 
-        }
-        flag = true;
+        SqlStmt* insert = SqlConnPool::Instance()->GetStmt(sql, INSERT_USER_STMT);
+        flag = insert && insert->Execute({ name, pwd });
+        if(!flag) { LOG_DEBUG("Insert error!"); }
     }
-    // SqlConnPool::Instance()->FreeConn(sql);
-    LOG_DEBUG( "UserVerify success!!");
+    LOG_DEBUG("UserVerify %s", flag ? "success" : "failed");
     return flag;
 }
 
@@ -3,14 +3,19 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <string>
-#include <regex>    // 正则表达式
+#include <string_view>
+#include <stdlib.h>      // strtoull
+#include <ctype.h>
 #include <errno.h>     
 #include <mysql/mysql.h>  //mysql
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
 #include "../pool/sqlconnpool.h"
+#include "httpscan.h"
+#include "httpheader.h"
 
 class HttpRequest {
 public:
@@ -24,14 +29,31 @@ public:
         /// 解析结束
         FINISH,        
     };
+
+    // parse()的返回值
+    enum PARSE_RESULT {
+        /// 数据还不完整，保留解析进度，等待更多数据
+        NEED_MORE,
+        /// 一个完整的请求解析完毕
+        COMPLETE,
+        /// 请求格式错误
+        BAD_REQUEST,
+    };
+
+    static const size_t MAX_LINE_LEN = 16384;       // 请求行/单个头部行的最大长度
+    static const size_t MAX_HEADER_BYTES = 65536;   // 请求行加全部头部(含CRLF)的最大字节数
+    static const size_t MAX_HEADER_CNT = 100;       // 头部的最大个数，重复的头部各算一个
+    static const size_t MAX_BODY_LEN = 1 << 20;     // 请求体的最大长度
     
-    HttpRequest() { Init(); }
+    HttpRequest() : present_(0), othersCnt_(0) { Init(); }
     ~HttpRequest() = default;
 
     // 初始化
     void Init();
-    // 解析Buffer
-    bool parse(Buffer& buff);   
+    // 解析Buffer，可以在多次读取之间分段调用，已解析的行会从buff中取走
+    PARSE_RESULT parse(Buffer& buff);
+    // 当前请求是否已经解析完毕
+    bool IsFinish() const { return state_ == FINISH; }
 
     // 获取请求路径
     std::string path() const;
@@ -49,16 +71,28 @@ public:
     // 判断是否保持连接
     bool IsKeepAlive() const;
 
+    // 是否带有某个已知头部
+    bool HasHeader(HttpHeader::ID id) const { return present_ & (1u << id); }
+    // 已知头部的值，不存在时为空串
+    const std::string& GetHeader(HttpHeader::ID id) const { return known_[id]; }
+    // 按名字(不区分大小写)取任意头部的值，不存在时为空
+    std::string_view GetHeader(std::string_view name) const;
+
 private:
-    bool ParseRequestLine_(const std::string& line);    // 处理请求行
-    void ParseHeader_(const std::string& line);         // 处理请求头
-    void ParseBody_(const std::string& line);           // 处理请求体
+    // 以下解析函数的参数都直接指向读缓冲区，不拷贝行
+    bool ParseRequestLine_(std::string_view line);      // 处理请求行
+    bool ParseHeader_(std::string_view line);           // 处理请求头
+    bool ParseHeaderEnd_();                             // 头部结束，确定请求体长度
+    void ParseBody_(std::string_view line);             // 处理请求体
 
     void ParsePath_();                                  // 处理请求路径
     void ParsePost_();                                  // 处理Post事件
     void ParseFromUrlencoded_();                        // 从url种解析编码
 
     static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);  // 用户验证
+    // 用户验证的预编译语句在连接池中的编号
+    static const int SELECT_USER_STMT;
+    static const int INSERT_USER_STMT;
 
     // 定义解析状态
     PARSE_STATE state_;
@@ -70,8 +104,20 @@ private:
     std::string version_;
     // 存储请求体
     std::string body_;
-    // 存储请求头
-    std::unordered_map<std::string, std::string> header_;
+    // 请求体长度(Content-Length)
+    size_t contentLen_;
+    // 读缓冲区开头的不完整行中已经扫描过、确定没有"\r\n"的字节数
+    size_t scanned_;
+    // 已取走的请求行和头部的字节数、头部个数，用于限制一个请求能占用的内存
+    size_t headerBytes_;
+    size_t headerCnt_;
+    // 已知头部按编号存放，字符串在请求之间复用，不再每个请求分配
+    std::string known_[HttpHeader::COUNT];
+    uint32_t present_;      // 出现过的已知头部的位图
+    static_assert(HttpHeader::COUNT <= 32, "present_ holds one bit per known header");
+    // 其他头部(名字, 值)，同样复用，只有前othersCnt_个有效
+    std::vector<std::pair<std::string, std::string>> others_;
+    size_t othersCnt_;
     // 存储请求参数
     std::unordered_map<std::string, std::string> post_;
 
@@ -20,15 +20,26 @@ const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
     { ".avi",   "video/x-msvideo" },
     { ".gz",    "application/x-gzip" },
     { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
+    { ".css",   "text/css" },
+    { ".js",    "text/javascript" },
+    { ".json",  "application/json" },
+    { ".svg",   "image/svg+xml" },
+    { ".ico",   "image/x-icon" },
+    { ".woff",  "font/woff" },
+    { ".woff2", "font/woff2" },
+    { ".ttf",   "font/ttf" },
+    { ".otf",   "font/otf" },
+    { ".eot",   "application/vnd.ms-fontobject" },
 };
     // 编码状态集
 const unordered_map<int, string> HttpResponse::CODE_STATUS = {
     { 200, "OK" },
+    { 206, "Partial Content" },
+    { 304, "Not Modified" },
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 416, "Range Not Satisfiable" },
 };
     // 编码路径集
 const unordered_map<int, string> HttpResponse::CODE_PATH = {
@@ -37,6 +48,32 @@ const unordered_map<int, string> HttpResponse::CODE_PATH = {
     { 404, "/404.html" },
 };
 
+size_t HttpResponse::sendfileThreshold = 256 * 1024;
+
+// 页面每次校验，样式脚本缓存一天，图片字体缓存一周
+unordered_map<string, int> HttpResponse::maxAge_ = {
+    { "text/html",          0 },
+    { "text/css",           86400 },
+    { "text/javascript",    86400 },
+    { "image/png",          604800 },
+    { "image/gif",          604800 },
+    { "image/jpeg",         604800 },
+    { "image/svg+xml",      604800 },
+    { "image/x-icon",       604800 },
+    { "font/woff",          604800 },
+    { "font/woff2",         604800 },
+    { "font/ttf",           604800 },
+    { "font/otf",           604800 },
+    { "application/vnd.ms-fontobject", 604800 },
+};
+
+int HttpResponse::defaultMaxAge_ = 3600;
+
+int HttpResponse::MaxAge(const string& type) {
+    auto it = maxAge_.find(type);
+    return it != maxAge_.end() ? it->second : defaultMaxAge_;
+}
+
 // 构造函数
 HttpResponse::HttpResponse() {
     // 初始化响应状态码
@@ -49,6 +86,10 @@ HttpResponse::HttpResponse() {
     mmFile_ = nullptr; 
     // 初始化文件状态
     mmFileStat_ = { 0 };
+    fileFd_ = -1;
+    encodings_ = 0;
+    buffMark_ = 0;
+    bodyLen_ = 0;
 };
 
 HttpResponse::~HttpResponse() {
@@ -56,11 +97,12 @@ HttpResponse::~HttpResponse() {
 }
 
 // 初始化HttpResponse类的成员变量
-void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
+void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code,
+                        string_view acceptEncoding){
     // 断言srcDir不为空
     assert(srcDir != "");
-    // 如果mmFile_不为空，则取消映射文件
-    if(mmFile_) { UnmapFile(); }
+    // 取消上一个响应的文件映射、关闭文件
+    UnmapFile();
     // 设置code_
     code_ = code;
     // 设置isKeepAlive_
@@ -73,31 +115,345 @@ void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, in
     mmFile_ = nullptr; 
     // 设置mmFileStat_
     mmFileStat_ = { 0 };
+    cached_.reset();
+    encodings_ = acceptEncoding.empty() ? 0 : ParseAcceptEncoding(acceptEncoding);
+    ifNoneMatch_ = ifModifiedSince_ = range_ = ifRange_ = string_view();
+    slices_.clear();
+}
+
+void HttpResponse::SetConditional(string_view ifNoneMatch, string_view ifModifiedSince) {
+    ifNoneMatch_ = ifNoneMatch;
+    ifModifiedSince_ = ifModifiedSince;
+}
+
+void HttpResponse::SetRange(string_view range, string_view ifRange) {
+    range_ = range;
+    ifRange_ = ifRange;
+    if(!range_.empty()) {
+        encodings_ = 0;     // 范围总是针对未压缩的文件
+    }
 }
 
 void HttpResponse::MakeResponse(Buffer& buff) {
-    /* 判断请求的资源文件 */
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;
+    buffMark_ = buff.ReadableBytes();
+    bodyLen_ = 0;
+    /* 先查缓存，命中时不再stat/open/mmap */
+    bool hit = (code_ == 200 || code_ == -1) && LookupCache_();
+    bool statKnown = false;
+    if(hit && cached_->large) {
+        // 过大的文件只缓存了stat的结果，省掉stat，按未缓存的文件发送
+        mmFileStat_.st_mode = S_IFREG | S_IROTH;
+        mmFileStat_.st_size = cached_->size;
+        mmFileStat_.st_ino = cached_->ino;
+        mmFileStat_.st_mtim = cached_->mtime;
+        cached_.reset();
+        hit = false;
+        statKnown = true;
     }
-    else if(!(mmFileStat_.st_mode & S_IROTH)) {
-        code_ = 403;
+    if(hit) {
+        code_ = 200;
+        etag_ = cached_->etag;
+        lastModified_ = cached_->lastModified;
+        if(NotModified_(cached_->mtime.tv_sec)) {
+            code_ = 304;
+            cached_.reset();    // 不发送内容
+        }
+    }
+    else {
+        /* 判断请求的资源文件 */
+        if(!statKnown && (stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode))) {
+            code_ = 404;
+        }
+        else if(!(mmFileStat_.st_mode & S_IROTH)) {
+            code_ = 403;
+        }
+        else if(code_ == -1) { 
+            code_ = 200; 
+        }
+        if(code_ == 200) {
+            // 只用stat的结果判断，304时不打开也不映射文件
+            FileCache::MakeETag(mmFileStat_.st_ino, mmFileStat_.st_size, mmFileStat_.st_mtim,
+                                FileCache::RAW, etag_);
+            FileCache::HttpDate(mmFileStat_.st_mtim.tv_sec, lastModified_);
+            if(NotModified_(mmFileStat_.st_mtim.tv_sec)) {
+                code_ = 304;
+            }
+        }
+        if(CODE_PATH.count(code_) == 1) {
+            ErrorHtml_();
+            LookupCache_();     // 错误页面同样可以缓存
+        }
     }
-    else if(code_ == -1) { 
-        code_ = 200; 
+    if(code_ == 200 && !range_.empty() && IfRangeMatch_()) {
+        int ret = ParseRange_(FileLen());
+        if(ret > 0) {
+            code_ = 206;
+        } else if(ret < 0) {
+            code_ = 416;
+        }
     }
-    ErrorHtml_();
     AddStateLine_(buff);
     AddHeader_(buff);
+    if(code_ == 304) {
+        buff.Append("\r\n");    // 没有消息体
+        return;
+    }
+    if(code_ == 416) {
+        buff.Append("Content-Range: bytes */" + to_string(FileLen()) + "\r\nContent-length: 0\r\n\r\n");
+        cached_.reset();
+        mmFileStat_.st_size = 0;
+        return;
+    }
     AddContent_(buff);
 }
 
+bool HttpResponse::IfRangeMatch_() const {
+    if(ifRange_.empty()) {
+        return true;
+    }
+    if(ifRange_.front() == '"' || ifRange_.front() == 'W') {
+        return ifRange_ == etag_;   // 弱ETag不会与强校验值相等
+    }
+    return ifRange_ == lastModified_;
+}
+
+// 只接受不超过18位的十进制数，避免溢出
+static bool ParseOffset(string_view digits, size_t* value) {
+    if(digits.empty() || digits.size() > 18) { return false; }
+    size_t v = 0;
+    for(char c: digits) {
+        if(c < '0' || c > '9') { return false; }
+        v = v * 10 + (c - '0');
+    }
+    *value = v;
+    return true;
+}
+
+int HttpResponse::ParseRange_(size_t size) {
+    slices_.clear();
+    string_view value = range_;
+    if(value.size() < 6 || !HttpHeader::EqualsIgnoreCase(value.substr(0, 6), "bytes=")) {
+        return 0;
+    }
+    value.remove_prefix(6);
+    size_t count = 0;
+    while(!value.empty()) {
+        size_t comma = value.find(',');
+        string_view item = value.substr(0, comma);
+        value = comma == string_view::npos ? string_view() : value.substr(comma + 1);
+        while(!item.empty() && (item.front() == ' ' || item.front() == '\t')) { item.remove_prefix(1); }
+        while(!item.empty() && (item.back() == ' ' || item.back() == '\t')) { item.remove_suffix(1); }
+        if(item.empty()) { continue; }
+        if(++count > MAX_RANGES) { return 0; }
+
+        size_t dash = item.find('-');
+        if(dash == string_view::npos) { return 0; }
+        size_t first = 0, last = 0;
+        if(dash == 0) {
+            // 后缀范围"-n"：最后n个字节
+            if(!ParseOffset(item.substr(1), &last)) { return 0; }
+            if(last == 0 || size == 0) { continue; }
+            first = last < size ? size - last : 0;
+            last = size - 1;
+        } else {
+            if(!ParseOffset(item.substr(0, dash), &first)) { return 0; }
+            if(dash + 1 == item.size()) {
+                last = size - 1;    // "a-"到文件末尾
+            } else if(!ParseOffset(item.substr(dash + 1), &last) || last < first) {
+                return 0;
+            }
+            if(first >= size) { continue; }
+            last = min(last, size - 1);
+        }
+        slices_.push_back({ static_cast<off_t>(first), last - first + 1, 0 });
+    }
+    if(slices_.empty()) {
+        return count > 0 ? -1 : 0;
+    }
+    // 按起点排序后合并重叠或相邻的范围
+    sort(slices_.begin(), slices_.end(), [](const Slice& a, const Slice& b) { return a.offset < b.offset; });
+    size_t n = 0;
+    for(size_t i = 1; i < slices_.size(); i++) {
+        Slice& cur = slices_[n];
+        off_t end = cur.offset + cur.len;
+        if(slices_[i].offset <= end) {
+            cur.len = max<off_t>(end, slices_[i].offset + slices_[i].len) - cur.offset;
+        } else {
+            slices_[++n] = slices_[i];
+        }
+    }
+    slices_.resize(n + 1);
+    return 1;
+}
+
+void HttpResponse::AddRanges_(Buffer& buff) {
+    size_t total = FileLen();
+    if(slices_.size() == 1) {
+        Slice& slice = slices_[0];
+        buff.Append("Content-Range: bytes " + to_string(slice.offset) + "-" + to_string(slice.offset + slice.len - 1)
+                    + "/" + to_string(total) + "\r\nContent-length: " + to_string(slice.len) + "\r\n\r\n");
+        slice.textBefore = buff.ReadableBytes() - buffMark_;
+        bodyLen_ = slice.len;
+        return;
+    }
+    // multipart/byteranges：先算出每段分隔的长度得到总长度，再依次写入
+    static atomic<uint32_t> counter(0);
+    char boundary[24];
+    snprintf(boundary, sizeof(boundary), "%020u", ++counter);
+    const string& type = GetFileType_();
+    vector<string> parts(slices_.size());
+    size_t length = 0;
+    for(size_t i = 0; i < slices_.size(); i++) {
+        const Slice& slice = slices_[i];
+        parts[i].append(i == 0 ? "--" : "\r\n--").append(boundary)
+                .append("\r\nContent-type: ").append(type)
+                .append("\r\nContent-Range: bytes ").append(to_string(slice.offset)).append("-")
+                .append(to_string(slice.offset + slice.len - 1)).append("/").append(to_string(total))
+                .append("\r\n\r\n");
+        length += parts[i].size() + slice.len;
+    }
+    string trailer = string("\r\n--") + boundary + "--\r\n";
+    length += trailer.size();
+    bodyLen_ = length;
+    buff.Append(string("Content-type: multipart/byteranges; boundary=") + boundary
+                + "\r\nContent-length: " + to_string(length) + "\r\n\r\n");
+    size_t mark = buffMark_;
+    for(size_t i = 0; i < slices_.size(); i++) {
+        buff.Append(parts[i]);
+        slices_[i].textBefore = buff.ReadableBytes() - mark;
+        mark = buff.ReadableBytes();
+    }
+    buff.Append(trailer);
+}
+
+bool HttpResponse::NotModified_(time_t mtime) const {
+    if(!ifNoneMatch_.empty()) {
+        return MatchETag_(ifNoneMatch_, etag_);
+    }
+    time_t since;
+    if(!ifModifiedSince_.empty() && ParseHttpDate_(ifModifiedSince_, &since)) {
+        return mtime <= since;
+    }
+    return false;
+}
+
+bool HttpResponse::MatchETag_(string_view list, string_view etag) {
+    while(!list.empty()) {
+        size_t comma = list.find(',');
+        string_view item = list.substr(0, comma);
+        list = comma == string_view::npos ? string_view() : list.substr(comma + 1);
+        while(!item.empty() && (item.front() == ' ' || item.front() == '\t')) { item.remove_prefix(1); }
+        while(!item.empty() && (item.back() == ' ' || item.back() == '\t')) { item.remove_suffix(1); }
+        if(item == "*") { return true; }
+        if(item.size() > 2 && item[0] == 'W' && item[1] == '/') { item.remove_prefix(2); }    // 弱比较
+        if(item == etag) { return true; }
+    }
+    return false;
+}
+
+bool HttpResponse::ParseHttpDate_(string_view value, time_t* t) {
+    char buf[64];
+    if(value.size() >= sizeof(buf)) { return false; }
+    value.copy(buf, value.size());
+    buf[value.size()] = '\0';
+    struct tm tm = {};
+    const char* end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if(!end || *end != '\0') { return false; }
+    *t = timegm(&tm);
+    return true;
+}
+
+// 缓存关闭、文件过大或不可读时返回false，走原来的stat + mmap流程(不压缩)
+bool HttpResponse::LookupCache_() {
+    FileCache* cache = FileCache::Instance();
+    const string& type = GetFileType_();
+    bool compressible = IsCompressible_(type);
+    filePath_.assign(srcDir_).append(path_);
+    if(compressible && encodings_) {
+        // 预压缩的兄弟文件优先，不存在时缓存里记着空条目，不会每次都去探测
+        if(encodings_ & ENC_BR) {
+            siblingPath_.assign(filePath_).append(".br");
+            cached_ = cache->Get(siblingPath_, type, FileCache::BR_FILE, true);
+            if(cached_) { return true; }
+        }
+        if(encodings_ & ENC_GZIP) {
+            siblingPath_.assign(filePath_).append(".gz");
+            cached_ = cache->Get(siblingPath_, type, FileCache::GZIP_FILE, true);
+            if(cached_) { return true; }
+            // 文件太小或压缩后没有变小时返回空，发原文件
+            cached_ = cache->Get(filePath_, type, FileCache::GZIP, true);
+            if(cached_) { return true; }
+        }
+    }
+    cached_ = cache->Get(filePath_, type, FileCache::RAW, compressible);
+    return cached_ != nullptr;
+}
+
+bool HttpResponse::IsCompressible_(const string& type) {
+    if(type.compare(0, 5, "text/") == 0 || type.compare(0, 5, "font/") == 0) {
+        return type != "font/woff" && type != "font/woff2";     // woff自带压缩
+    }
+    return type == "application/json" || type == "application/xhtml+xml"
+        || type == "image/svg+xml" || type == "application/vnd.ms-fontobject";
+}
+
+int HttpResponse::ParseAcceptEncoding(string_view value) {
+    int accepted = 0, listed = 0;
+    bool star = false;
+    while(!value.empty()) {
+        size_t comma = value.find(',');
+        string_view item = value.substr(0, comma);
+        value = comma == string_view::npos ? string_view() : value.substr(comma + 1);
+
+        // coding [ ; q=qvalue ]
+        size_t semi = item.find(';');
+        string_view coding = item.substr(0, semi);
+        while(!coding.empty() && (coding.front() == ' ' || coding.front() == '\t')) { coding.remove_prefix(1); }
+        while(!coding.empty() && (coding.back() == ' ' || coding.back() == '\t')) { coding.remove_suffix(1); }
+        bool ok = true;
+        if(semi != string_view::npos) {
+            string_view param = item.substr(semi + 1);
+            while(!param.empty() && (param.front() == ' ' || param.front() == '\t')) { param.remove_prefix(1); }
+            if(param.size() >= 2 && HttpHeader::Lower(param[0]) == 'q' && param[1] == '=') {
+                // q值为0、0.0、0.00、0.000时拒绝
+                param.remove_prefix(2);
+                ok = false;
+                for(char c: param) {
+                    if(c >= '1' && c <= '9') { ok = true; break; }
+                    if(c != '0' && c != '.') { break; }
+                }
+            }
+        }
+        int bit = 0;
+        if(HttpHeader::EqualsIgnoreCase(coding, "gzip") || HttpHeader::EqualsIgnoreCase(coding, "x-gzip")) {
+            bit = ENC_GZIP;
+        } else if(HttpHeader::EqualsIgnoreCase(coding, "br")) {
+            bit = ENC_BR;
+        } else if(coding == "*") {
+            star = ok;
+            continue;
+        }
+        listed |= bit;
+        if(ok) { accepted |= bit; }
+    }
+    if(star) {
+        accepted |= (ENC_GZIP | ENC_BR) & ~listed;
+    }
+    return accepted;
+}
+
 char* HttpResponse::File() {
-    return mmFile_;
+    return cached_ ? const_cast<char*>(cached_->data.data()) : mmFile_;
+}
+
+char* HttpResponse::ReleaseFile() {
+    char* file = mmFile_;
+    mmFile_ = nullptr;
+    return file;
 }
 
 size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+    return cached_ ? cached_->data.size() : mmFileStat_.st_size;
 }
 
 // 如果code_在CODE_PATH中存在
@@ -140,28 +496,89 @@ void HttpResponse::AddHeader_(Buffer& buff) {
         //关闭连接
         buff.Append("close\r\n");
     }
-    //添加响应内容类型
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    //校验值和缓存时间
+    if(code_ == 200 || code_ == 206 || code_ == 304) {
+        const string& type = GetFileType_();
+        buff.Append("ETag: ");
+        buff.Append(etag_);
+        buff.Append("\r\nLast-Modified: ");
+        buff.Append(lastModified_);
+        buff.Append("\r\n");
+        int age = MaxAge(type);
+        if(age > 0) {
+            buff.Append("Cache-Control: max-age=" + to_string(age) + "\r\n");
+        } else if(age == 0) {
+            buff.Append("Cache-Control: no-cache\r\n");
+        }
+        if(code_ == 304) {
+            if(IsCompressible_(type)) {
+                buff.Append("Vary: Accept-Encoding\r\n");
+            }
+            return;
+        }
+        buff.Append("Accept-Ranges: bytes\r\n");
+    }
+    //添加响应内容类型和Vary(缓存条目里已经带有，multipart的类型在AddRanges_中添加)
+    if(!cached_ || code_ == 206 || code_ == 416) {
+        const string& type = GetFileType_();
+        if(slices_.size() <= 1) {
+            buff.Append("Content-type: " + type + "\r\n");
+        }
+        if(IsCompressible_(type)) {
+            buff.Append("Vary: Accept-Encoding\r\n");
+        }
+    }
 }
 
 void HttpResponse::AddContent_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
+    if(cached_) {
+        if(code_ == 206) {
+            AddRanges_(buff);
+        } else {
+            buff.Append(cached_->headers);  // 预先生成的Content-type和Content-length
+            bodyLen_ = cached_->data.size();
+        }
+        return;
+    }
+    int srcFd = open((srcDir_ + path_).data(), O_RDONLY | O_CLOEXEC);
     if(srcFd < 0) { 
         ErrorContent(buff, "File NotFound!");
         return; 
     }
-    //将文件映射到内存提高文件的访问速度  MAP_PRIVATE 建立一个写入时拷贝的私有映射
     LOG_DEBUG("file path %s", (srcDir_ + path_).data());
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
+    if(mmFileStat_.st_size == 0) {      // 空文件无法映射，也没有内容要发
+        close(srcFd);
+        buff.Append("Content-length: 0\r\n\r\n");
+        return;
+    }
+    // 大文件保留描述符，由sendfile在内核中直接发送，不建立映射
+    if(static_cast<size_t>(mmFileStat_.st_size) >= sendfileThreshold) {
+        fileFd_ = srcFd;
+        if(code_ == 206) {
+            AddRanges_(buff);
+        } else {
+            buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+            bodyLen_ = mmFileStat_.st_size;
+        }
+        return;
+    }
+    //将文件映射到内存提高文件的访问速度  MAP_PRIVATE 建立一个写入时拷贝的私有映射
+    void* mmRet = mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
+    if(mmRet == MAP_FAILED) {
+        close(srcFd);
         ErrorContent(buff, "File NotFound!");
         return; 
     }
     mmFile_ = (char*)mmRet;
     //关闭文件描述符
     close(srcFd);
-    //将Content-length添加到响应头中
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    //将Content-length添加到响应头中，206时只发送映射中的片段
+    if(code_ == 206) {
+        AddRanges_(buff);
+    } else {
+        buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+        bodyLen_ = mmFileStat_.st_size;
+    }
 }
 
 void HttpResponse::UnmapFile() {
@@ -169,23 +586,36 @@ void HttpResponse::UnmapFile() {
         munmap(mmFile_, mmFileStat_.st_size);
         mmFile_ = nullptr;
     }
+    if(fileFd_ >= 0) {
+        close(fileFd_);
+        fileFd_ = -1;
+    }
+    cached_.reset();
+}
+
+int HttpResponse::ReleaseFd() {
+    int fd = fileFd_;
+    fileFd_ = -1;
+    return fd;
 }
 
 // 判断文件类型 
-string HttpResponse::GetFileType_() {
+const string& HttpResponse::GetFileType_() {
+    static const string DEFAULT_TYPE = "text/plain";
     string::size_type idx = path_.find_last_of('.');
     if(idx == string::npos) {   // 最大值 find函数在找不到指定值得情况下会返回string::npos
-        return "text/plain";
+        return DEFAULT_TYPE;
     }
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    auto it = SUFFIX_TYPE.find(path_.substr(idx));
+    if(it != SUFFIX_TYPE.end()) {
+        return it->second;
     }
-    return "text/plain";
+    return DEFAULT_TYPE;
 }
 
 void HttpResponse::ErrorContent(Buffer& buff, string message) 
 {
+    slices_.clear();
     string body;
     string status;
     body += "<html><title>Error</title>";
@@ -201,5 +631,6 @@ void HttpResponse::ErrorContent(Buffer& buff, string message)
 
     buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
     buff.Append(body);
+    bodyLen_ = body.size();
 }
 
@@ -6,31 +6,86 @@
 #include <unistd.h>      // close
 #include <sys/stat.h>    // stat
 #include <sys/mman.h>    // mmap, munmap
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <algorithm>
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "filecache.h"
+#include "httpheader.h"
 
 class HttpResponse {
 public:
     HttpResponse();
     ~HttpResponse();
 
-    // 初始化，参数：源文件目录，路径，是否保持存活，错误码
-    void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    // 初始化，参数：源文件目录，路径，是否保持存活，错误码，请求的Accept-Encoding
+    void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1,
+              std::string_view acceptEncoding = {});
+    // 设置条件请求头(只对GET调用)，视图需在MakeResponse之前保持有效
+    void SetConditional(std::string_view ifNoneMatch, std::string_view ifModifiedSince);
+    // 设置Range和If-Range(只对GET调用)，视图需在MakeResponse之前保持有效；带Range时不压缩
+    void SetRange(std::string_view range, std::string_view ifRange);
     // 构造响应
     void MakeResponse(Buffer& buff);
     // 取消映射文件
     void UnmapFile();
     // 获取文件指针
     char* File();
+    // 交出文件映射的所有权，之后由调用方负责munmap(流水线中排队发送的响应使用)
+    char* ReleaseFile();
+    // 大文件不映射，返回打开的文件描述符(没有时为-1)，由连接用sendfile发送
+    int FileFd() const { return fileFd_; }
+    // 交出文件描述符的所有权，之后由调用方负责close
+    int ReleaseFd();
+    // 文件来自缓存时返回缓存条目，调用方持有它直到文件内容发送完
+    std::shared_ptr<const FileCache::Entry> CachedFile() const { return cached_; }
     // 获取文件长度
     size_t FileLen() const;
     // 构造错误响应
     void ErrorContent(Buffer& buff, std::string message);
     // 获取错误码
     int Code() const { return code_; }
+    // 消息体的字节数，即发送的Content-length(304等没有消息体时为0)
+    size_t BodyLen() const { return bodyLen_; }
+
+    // 206响应要发送的文件片段：先发textBefore字节的头部(或multipart分隔)，再发文件[offset, offset+len)
+    // 最后一个片段之后剩余的头部缓冲区内容是multipart的结束分隔
+    struct Slice {
+        off_t offset;
+        size_t len;
+        size_t textBefore;
+    };
+    // 206时非空，否则整个文件紧跟在响应头后面
+    const std::vector<Slice>& Slices() const { return slices_; }
+    // 一个请求最多的范围数，超过时忽略Range发送整个文件
+    static const size_t MAX_RANGES = 16;
+
+    // 不小于该大小且未被缓存的文件用sendfile发送，而不是mmap后writev
+    static size_t sendfileThreshold;
+
+    // 客户端接受的内容编码
+    enum ENCODING {
+        ENC_GZIP = 1 << 0,
+        ENC_BR   = 1 << 1,
+    };
+    // 解析Accept-Encoding，返回ENCODING的组合；q=0表示拒绝，"*"表示接受其余未列出的编码
+    static int ParseAcceptEncoding(std::string_view value);
+
+    // 按内容类型设置Cache-Control的max-age(秒)，0表示no-cache(每次都要条件请求校验)，负数表示不发送
+    // 不加锁，须在服务器启动前设置
+    static void SetMaxAge(const std::string& type, int seconds) { maxAge_[type] = seconds; }
+    // 没有单独设置的类型使用的max-age
+    static void SetDefaultMaxAge(int seconds) { defaultMaxAge_ = seconds; }
+    // 某个类型实际使用的max-age
+    static int MaxAge(const std::string& type);
 
 private:
+    // 按内容类型的max-age和没有单独设置时的默认值
+    static std::unordered_map<std::string, int> maxAge_;
+    static int defaultMaxAge_;
 
     //  添加状态行到缓冲区buff中
     void AddStateLine_(Buffer &buff);
@@ -42,7 +97,24 @@ private:
     // 发生错误时调用
     void ErrorHtml_();
     // 获取文件类型
-    std::string GetFileType_();
+    const std::string& GetFileType_();
+    // 从缓存取当前路径的文件，类型可压缩时按客户端接受的编码依次尝试.br、.gz兄弟文件和gzip压缩
+    bool LookupCache_();
+    // 文本类的内容类型才值得压缩
+    static bool IsCompressible_(const std::string& type);
+    // 按If-None-Match(优先)或If-Modified-Since判断客户端的副本是否仍然有效
+    bool NotModified_(time_t mtime) const;
+    // If-None-Match中是否有与etag_弱比较相等的值
+    static bool MatchETag_(std::string_view list, std::string_view etag);
+    // 解析IMF-fixdate格式的HTTP-date
+    static bool ParseHttpDate_(std::string_view value, time_t* t);
+    // If-Range与当前的ETag(强比较)或Last-Modified一致时才处理Range
+    bool IfRangeMatch_() const;
+    // 按文件大小解析range_到slices_(排序并合并重叠的范围)
+    // 返回1表示可以满足，-1表示都不能满足(416)，0表示格式错误或范围过多，忽略Range
+    int ParseRange_(size_t size);
+    // 写入Content-Range/Content-length以及multipart的分隔，填写各片段的textBefore
+    void AddRanges_(Buffer& buff);
 
     // HTTP状态码
     int code_;
@@ -58,6 +130,30 @@ private:
     char* mmFile_; 
     // 源文件状态
     struct stat mmFileStat_;
+    // 用sendfile发送的文件
+    int fileFd_;
+    // 缓存命中时的文件，与mmFile_、fileFd_三选一
+    std::shared_ptr<const FileCache::Entry> cached_;
+    // srcDir_ + path_，复用以免每次拼接分配
+    std::string filePath_;
+    // 预压缩兄弟文件的路径，同样复用
+    std::string siblingPath_;
+    // 客户端接受的编码(ENCODING的组合)
+    int encodings_;
+    // 条件请求头，指向请求中的字符串
+    std::string_view ifNoneMatch_;
+    std::string_view ifModifiedSince_;
+    std::string_view range_;
+    std::string_view ifRange_;
+    // 206响应的片段
+    std::vector<Slice> slices_;
+    // 本次响应开始时缓冲区中的字节数
+    size_t buffMark_;
+    // 消息体的字节数
+    size_t bodyLen_;
+    // 当前响应的校验值，复用以免每次分配
+    std::string etag_;
+    std::string lastModified_;
 
     // 后缀类型集
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;  
@@ -0,0 +1,268 @@
+#include "httpscan.h"
+#include <string.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+// 头部中允许的字节: HT、SP、可见字符以及0x80以上的obs-text
+static inline bool IsInvalidByte(unsigned char ch) {
+    return (ch < 0x20 && ch != '\t') || ch == 0x7F;
+}
+
+/* ---------- 标量实现 ---------- */
+
+static const char* FindCRLFScalar(const char* begin, const char* end) {
+    const char* p = begin;
+    while(p < end) {
+        p = static_cast<const char*>(memchr(p, '\r', end - p));
+        if(!p || p + 1 >= end) { break; }
+        if(p[1] == '\n') { return p; }
+        p++;
+    }
+    return end;
+}
+
+static const char* FindCharScalar(const char* begin, const char* end, char c) {
+    const char* p = static_cast<const char*>(memchr(begin, c, end - begin));
+    return p ? p : end;
+}
+
+static const char* FindInvalidScalar(const char* begin, const char* end) {
+    for(const char* p = begin; p < end; p++) {
+        if(IsInvalidByte(static_cast<unsigned char>(*p))) { return p; }
+    }
+    return end;
+}
+
+#ifdef HTTP_SCAN_X86
+
+/* ---------- SSE4.2实现，每次16字节 ---------- */
+
+__attribute__((target("sse4.2")))
+static const char* FindCRLFSse42(const char* begin, const char* end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char* p = begin;
+    // 同时比较p处的'\r'和p+1处的'\n'，所以要多留一个字节
+    while(end - p >= 17) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if(mask) { return p + __builtin_ctz(mask); }
+        p += 16;
+    }
+    return FindCRLFScalar(p, end);
+}
+
+__attribute__((target("sse4.2")))
+static const char* FindCharSse42(const char* begin, const char* end, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    const char* p = begin;
+    while(end - p >= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, needle));
+        if(mask) { return p + __builtin_ctz(mask); }
+        p += 16;
+    }
+    return FindCharScalar(p, end, c);
+}
+
+// 用PCMPESTRI的区间比较一次判断16个字节是否落在非法区间内
+__attribute__((target("sse4.2")))
+static const char* FindInvalidSse42(const char* begin, const char* end) {
+    const __m128i ranges = _mm_setr_epi8(0x00, 0x08, 0x0A, 0x1F, 0x7F, 0x7F,
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const char* p = begin;
+    while(end - p >= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int idx = _mm_cmpestri(ranges, 6, a, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if(idx < 16) { return p + idx; }
+        p += 16;
+    }
+    return FindInvalidScalar(p, end);
+}
+
+/* ---------- AVX2实现，每次32字节 ---------- */
+// 不足32字节的尾部在同一target内用16字节的VEX指令处理，再交给标量实现；
+// 头部行大多短于32字节，转到非VEX编码的SSE4.2函数会付出AVX/SSE切换的代价
+
+__attribute__((target("avx2")))
+static const char* FindCRLFAvx2(const char* begin, const char* end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char* p = begin;
+    while(end - p >= 33) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf))));
+        if(mask) { return p + __builtin_ctz(mask); }
+        p += 32;
+    }
+    if(end - p >= 17) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, _mm256_castsi256_si128(cr)),
+                                                   _mm_cmpeq_epi8(b, _mm256_castsi256_si128(lf))));
+        if(mask) { return p + __builtin_ctz(mask); }
+        p += 16;
+    }
+    return FindCRLFScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* FindCharAvx2(const char* begin, const char* end, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    const char* p = begin;
+    while(end - p >= 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, needle)));
+        if(mask) { return p + __builtin_ctz(mask); }
+        p += 32;
+    }
+    if(end - p >= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm256_castsi256_si128(needle)));
+        if(mask) { return p + __builtin_ctz(mask); }
+        p += 16;
+    }
+    return FindCharScalar(p, end, c);
+}
+
+// 无符号 x <= 0x1F 等价于 min(x, 0x1F) == x，再去掉HT、加上DEL
+__attribute__((target("avx2")))
+static const char* FindInvalidAvx2(const char* begin, const char* end) {
+    const __m256i ctl = _mm256_set1_epi8(0x1F);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const char* p = begin;
+    while(end - p >= 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i isCtl = _mm256_cmpeq_epi8(_mm256_min_epu8(a, ctl), a);
+        __m256i bad = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(a, tab), isCtl),
+                                      _mm256_cmpeq_epi8(a, del));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(bad));
+        if(mask) { return p + __builtin_ctz(mask); }
+        p += 32;
+    }
+    if(end - p >= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i isCtl = _mm_cmpeq_epi8(_mm_min_epu8(a, _mm256_castsi256_si128(ctl)), a);
+        __m128i bad = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(a, _mm256_castsi256_si128(tab)), isCtl),
+                                   _mm_cmpeq_epi8(a, _mm256_castsi256_si128(del)));
+        int mask = _mm_movemask_epi8(bad);
+        if(mask) { return p + __builtin_ctz(mask); }
+        p += 16;
+    }
+    return FindInvalidScalar(p, end);
+}
+
+#endif // HTTP_SCAN_X86
+
+/* ---------- 运行时分派 ---------- */
+
+bool HttpScan::Supported_(ISA isa) {
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();   // 静态初始化阶段调用时需要先初始化CPU信息
+    switch(isa) {
+    case AVX2:  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+    case SSE42: return __builtin_cpu_supports("sse4.2");
+    default:    return true;
+    }
+#else
+    return isa == SCALAR;
+#endif
+}
+
+HttpScan::Kernels HttpScan::Make_(ISA isa) {
+#ifdef HTTP_SCAN_X86
+    if(isa == AVX2) { return { AVX2, FindCRLFAvx2, FindCharAvx2, FindInvalidAvx2 }; }
+    if(isa == SSE42) { return { SSE42, FindCRLFSse42, FindCharSse42, FindInvalidSse42 }; }
+#endif
+    return { SCALAR, FindCRLFScalar, FindCharScalar, FindInvalidScalar };
+}
+
+// 校准用的典型请求头，行长和真实浏览器请求相近
+static const char CALIBRATE_SAMPLE[] =
+    "GET /images/profile-image.jpg HTTP/1.1\r\n"
+    "Host: 192.168.1.20:1316\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Referer: http://192.168.1.20:1316/picture.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; session=3f2a9c0e8b7d4a1f9e6c5b4a3d2e1f0a\r\n"
+    "\r\n";
+
+// 按解析时的用法(切行、查非法字节、找冒号)扫一遍样本若干次，返回耗时(纳秒)
+static long long TimeKernels(const char* (*findCRLF)(const char*, const char*),
+                             const char* (*findChar)(const char*, const char*, char),
+                             const char* (*findInvalid)(const char*, const char*)) {
+    const char* end = CALIBRATE_SAMPLE + sizeof(CALIBRATE_SAMPLE) - 1;
+    volatile size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < 200; i++) {
+        const char* p = CALIBRATE_SAMPLE;
+        while(p < end) {
+            const char* lineEnd = findCRLF(p, end);
+            sink = sink + (findInvalid(p, lineEnd) - p) + (findChar(p, lineEnd, ':') - p);
+            p = lineEnd + 2;
+        }
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// AVX2一次32字节，但头部行大多很短，不一定比SSE4.2快：两种都支持时各测几轮取最好成绩，AVX2更快才用它
+HttpScan::ISA HttpScan::Calibrate_() {
+    if(!Supported_(SSE42)) { return SCALAR; }
+    if(!Supported_(AVX2)) { return SSE42; }
+    Kernels sse = Make_(SSE42), avx = Make_(AVX2);
+    long long sseBest = -1, avxBest = -1;
+    for(int round = 0; round < 5; round++) {    // 交替测量，减小频率变化和干扰的影响
+        long long t = TimeKernels(sse.findCRLF, sse.findChar, sse.findInvalid);
+        if(sseBest < 0 || t < sseBest) { sseBest = t; }
+        t = TimeKernels(avx.findCRLF, avx.findChar, avx.findInvalid);
+        if(avxBest < 0 || t < avxBest) { avxBest = t; }
+    }
+    return avxBest < sseBest ? AVX2 : SSE42;
+}
+
+HttpScan::Kernels& HttpScan::Active_() {
+    static Kernels kernels = Make_(Calibrate_());
+    return kernels;
+}
+
+const char* HttpScan::FindCRLF(const char* begin, const char* end) {
+    return Active_().findCRLF(begin, end);
+}
+
+const char* HttpScan::FindChar(const char* begin, const char* end, char c) {
+    return Active_().findChar(begin, end, c);
+}
+
+const char* HttpScan::FindInvalid(const char* begin, const char* end) {
+    return Active_().findInvalid(begin, end);
+}
+
+HttpScan::ISA HttpScan::Current() {
+    return Active_().isa;
+}
+
+const char* HttpScan::Name(ISA isa) {
+    switch(isa) {
+    case AVX2:  return "avx2";
+    case SSE42: return "sse4.2";
+    default:    return "scalar";
+    }
+}
+
+bool HttpScan::Use(ISA isa) {
+    if(!Supported_(isa)) { return false; }
+    Active_() = Make_(isa);
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <cstddef>
+
+/*
+请求解析用到的字节扫描函数
+每个函数都有标量、SSE4.2(一次16字节)、AVX2(一次32字节)三种实现，
+第一次调用时按CPUID筛出当前CPU支持的实现；SSE4.2和AVX2都支持时在典型请求头上各测一次，选实测更快的
+所有函数在[begin, end)内查找，找不到时返回end
+*/
+class HttpScan {
+public:
+    enum ISA {
+        SCALAR,
+        SSE42,
+        AVX2,
+    };
+
+    // 查找"\r\n"，返回'\r'的位置
+    static const char* FindCRLF(const char* begin, const char* end);
+    // 查找字符c第一次出现的位置
+    static const char* FindChar(const char* begin, const char* end, char c);
+    // 查找第一个头部中不允许出现的字节(除HT以外的控制字符和DEL)
+    static const char* FindInvalid(const char* begin, const char* end);
+
+    // 当前使用的实现
+    static ISA Current();
+    static const char* Name(ISA isa);
+    // 切换实现(CPU不支持时返回false)，仅供测试和基准使用，不能与解析并发调用
+    static bool Use(ISA isa);
+
+private:
+    struct Kernels {
+        ISA isa;
+        const char* (*findCRLF)(const char*, const char*);
+        const char* (*findChar)(const char*, const char*, char);
+        const char* (*findInvalid)(const char*, const char*);
+    };
+
+    static Kernels& Active_();
+    static bool Supported_(ISA isa);
+    static Kernels Make_(ISA isa);
+    static ISA Calibrate_();
+};
+
+#endif //HTTP_SCAN_H
@@ -0,0 +1,270 @@
+#include "accesslog.h"
+#include <arpa/inet.h>        // inet_ntop
+#include <fcntl.h>            // open
+#include <unistd.h>           // write, close
+#include <sys/stat.h>         // mkdir
+#include <errno.h>
+
+using namespace std;
+
+// 不内联：内联后目标长度是常量，编译器会把memcpy展开成逐字节复制的循环
+static void __attribute__((noinline)) CopyField(char* dst, size_t size, std::string_view s) {
+    size_t n = s.size() < size - 1 ? s.size() : size - 1;
+    memcpy(dst, s.data(), n);
+    dst[n] = '\0';
+}
+
+void AccessRecord::Fill(int64_t start, uint32_t addr, std::string_view m, std::string_view p, std::string_view v,
+                        std::string_view ref, std::string_view ua) {
+    timeNs = start;
+    ip = addr;
+    CopyField(method, sizeof(method), m);
+    CopyField(path, sizeof(path), p);
+    CopyField(version, sizeof(version), v);
+    CopyField(referer, sizeof(referer), ref);
+    CopyField(agent, sizeof(agent), ua);
+}
+
+AccessLog::AccessLog() {
+    sampleN_ = 0;
+    ringSize_ = 0;
+    fd_ = -1;
+    day_ = 0;
+    lastSec_ = -1;
+    date_[0] = '\0';
+    used_ = 0;
+    stop_ = false;
+    wakeup_ = false;
+    flushReq_ = 0;
+    flushDone_ = 0;
+    dropped_ = 0;
+}
+
+AccessLog::~AccessLog() {
+    if(writeThread_ && writeThread_->joinable()) {
+        stop_ = true;
+        cond_.notify_one();
+        writeThread_->join();   // 写线程取完所有缓冲区后退出
+    }
+    if(fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+AccessLog* AccessLog::Instance() {
+    static AccessLog log;
+    return &log;
+}
+
+void AccessLog::Init(const char* path, int sampleN, int capacity) {
+    {
+        lock_guard<mutex> locker(fileMtx_);
+        path_ = path;
+        if(fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        day_ = 0;       // 下一批按新路径重新打开
+    }
+    ringSize_ = static_cast<size_t>(capacity > 0 ? capacity : 1) * (LogRing::HEADER + sizeof(AccessRecord));
+    if(sampleN > 0 && !writeThread_) {
+        buf_.reset(new char[BATCH_BUF]);
+        writeThread_.reset(new thread([this]() { WriteThread_(); }));
+    }
+    sampleN_ = sampleN;
+}
+
+LogRing* AccessLog::LocalRing_() {
+    // 与Log相同：线程退出时只做标记，由写线程取完后释放
+    struct Holder {
+        LogRing* ring = nullptr;
+        ~Holder() { if(ring) { ring->Detach(); } }
+    };
+    thread_local Holder holder;
+    if(!holder.ring) {
+        unique_ptr<LogRing> ring(new LogRing(ringSize_));
+        holder.ring = ring.get();
+        lock_guard<mutex> locker(ringsMtx_);
+        rings_.push_back(move(ring));
+    }
+    return holder.ring;
+}
+
+void AccessLog::Append(const AccessRecord& rec) {
+    if(!writeThread_) {
+        return;
+    }
+    LogRing* ring = LocalRing_();
+    char* buf = ring->Reserve(sizeof(AccessRecord));
+    if(!buf) {
+        dropped_.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    memcpy(buf, &rec, sizeof(AccessRecord));
+    ring->Commit(LogRing::ACCESS, sizeof(AccessRecord));
+    // 超过一半时提前叫醒写线程
+    if(ring->ProducerUsed() > ring->Capacity() / 2 && !wakeup_.load(memory_order_relaxed)
+       && !wakeup_.exchange(true)) {
+        cond_.notify_one();
+    }
+}
+
+void AccessLog::Flush() {
+    if(!writeThread_) {
+        return;
+    }
+    uint64_t req = ++flushReq_;
+    unique_lock<mutex> locker(condMtx_);
+    cond_.notify_one();
+    flushCond_.wait_for(locker, chrono::seconds(1), [this, req]() { return flushDone_.load() >= req; });
+}
+
+void AccessLog::WriteThread_() {
+    while(true) {
+        uint64_t req = flushReq_.load();
+        size_t count = Drain_();
+        if(flushDone_.load() < req) {
+            lock_guard<mutex> locker(condMtx_);
+            flushDone_ = req;
+            flushCond_.notify_all();
+        }
+        if(count > 0) {
+            continue;
+        }
+        if(stop_) {
+            break;
+        }
+        unique_lock<mutex> locker(condMtx_);
+        cond_.wait_for(locker, chrono::milliseconds(FLUSH_MS),
+                       [this]() { return stop_ || wakeup_ || flushReq_.load() != flushDone_.load(); });
+        wakeup_ = false;
+    }
+}
+
+size_t AccessLog::Drain_() {
+    vector<LogRing*> rings;
+    {
+        lock_guard<mutex> locker(ringsMtx_);
+        for(size_t i = 0; i < rings_.size();) {
+            if(rings_[i]->Detached() && rings_[i]->Used() == 0) {
+                rings_[i] = move(rings_.back());
+                rings_.pop_back();
+                continue;
+            }
+            rings.push_back(rings_[i].get());
+            i++;
+        }
+    }
+    size_t count = 0;
+    lock_guard<mutex> locker(fileMtx_);
+    for(LogRing* ring: rings) {
+        size_t pos;
+        uint32_t tag, len;
+        const char* data;
+        while(ring->Front(pos, tag, data, len)) {
+            if(tag == LogRing::ACCESS && len == sizeof(AccessRecord)) {
+                AccessRecord rec;
+                memcpy(&rec, data, sizeof(rec));
+                if(used_ + LINE_LEN > BATCH_BUF) {
+                    WriteBatch_();
+                }
+                used_ += Format_(buf_.get() + used_, LINE_LEN, rec);
+                count++;
+            }
+            ring->Pop(pos, len);
+        }
+    }
+    WriteBatch_();
+    return count;
+}
+
+void AccessLog::WriteBatch_() {
+    if(used_ == 0) {
+        return;
+    }
+    OpenFile_(time(nullptr));
+    const char* p = buf_.get();
+    size_t left = used_;
+    while(fd_ >= 0 && left > 0) {
+        ssize_t len = ::write(fd_, p, left);
+        if(len < 0) {
+            if(errno == EINTR) { continue; }
+            break;      // 写失败时丢弃这一批
+        }
+        p += len;
+        left -= len;
+    }
+    used_ = 0;
+}
+
+// 按本地日期命名，日期变化时切换，一批只写进一个文件
+void AccessLog::OpenFile_(time_t sec) {
+    struct tm t;
+    localtime_r(&sec, &t);
+    int day = (t.tm_year + 1900) * 10000 + (t.tm_mon + 1) * 100 + t.tm_mday;
+    if(day == day_ && fd_ >= 0) {
+        return;
+    }
+    if(fd_ >= 0) {
+        close(fd_);
+    }
+    char fileName[512];
+    snprintf(fileName, sizeof(fileName), "%s/access_%04d_%02d_%02d.log",
+             path_.c_str(), t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd_ < 0) {
+        mkdir(path_.c_str(), 0777);
+        fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    day_ = day;
+}
+
+size_t AccessLog::Format_(char* buf, size_t size, const AccessRecord& rec) {
+    time_t sec = static_cast<time_t>(rec.timeNs / 1000000000);
+    if(sec != lastSec_) {
+        struct tm t;
+        localtime_r(&sec, &t);
+        strftime(date_, sizeof(date_), "%d/%b/%Y:%H:%M:%S %z", &t);
+        lastSec_ = sec;
+    }
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr addr;
+    addr.s_addr = rec.ip;
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+
+    size_t n = snprintf(buf, size, "%s - - [%s] \"", ip, date_);
+    n += Quote_(buf + n, size - n, rec.method);
+    buf[n++] = ' ';
+    n += Quote_(buf + n, size - n, rec.path);
+    if(rec.version[0]) {
+        n += snprintf(buf + n, size - n, " HTTP/");
+        n += Quote_(buf + n, size - n, rec.version);
+    }
+    if(rec.bytes) {
+        n += snprintf(buf + n, size - n, "\" %d %llu \"", rec.status, static_cast<unsigned long long>(rec.bytes));
+    } else {
+        n += snprintf(buf + n, size - n, "\" %d - \"", rec.status);     // CLF中没有正文时为"-"
+    }
+    n += Quote_(buf + n, size - n, rec.referer[0] ? rec.referer : "-");
+    n += snprintf(buf + n, size - n, "\" \"");
+    n += Quote_(buf + n, size - n, rec.agent[0] ? rec.agent : "-");
+    n += snprintf(buf + n, size - n, "\" %u %llu\n", rec.durUs, static_cast<unsigned long long>(rec.sent));
+    return n;
+}
+
+size_t AccessLog::Quote_(char* buf, size_t size, const char* s) {
+    static const char HEX[] = "0123456789ABCDEF";
+    size_t n = 0;
+    for(; *s && n + 5 < size; s++) {
+        unsigned char c = static_cast<unsigned char>(*s);
+        if(c == '"' || c == '\\' || c < 0x20 || c == 0x7f) {
+            buf[n++] = '\\';
+            buf[n++] = 'x';
+            buf[n++] = HEX[c >> 4];
+            buf[n++] = HEX[c & 0xf];
+        } else {
+            buf[n++] = c;
+        }
+    }
+    return n;
+}
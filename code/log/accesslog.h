@@ -0,0 +1,113 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "logring.h"
+
+/*
+访问日志，每个请求一行，Combined Log Format后面再加两列：服务时间(微秒)和发出的总字节数(头部加正文)
+CLF的字节数字段按规范只算正文，没有正文时为"-"
+127.0.0.1 - - [18/Oct/2026:06:26:09 +0800] "GET /index.html HTTP/1.1" 200 3073 "-" "curl/8.0" 125 3303
+请求线程只把字段拷进定长记录，写进本线程的环形缓冲区；格式化和写文件都由自己的写线程成批完成，
+和Log不共用缓冲区、文件和锁
+*/
+
+// 一个请求的访问记录，字符串超长时截断
+struct AccessRecord {
+    int64_t timeNs;         // 开始处理请求的时间(CLOCK_REALTIME)
+    uint64_t bytes;         // 发出的正文字节数，即CLF的字节数字段
+    uint64_t sent;          // 发出的总字节数(头部加正文)
+    uint32_t durUs;         // 从开始处理到响应发完
+    uint32_t ip;            // 网络字节序
+    uint16_t status;
+    char method[8];
+    char version[8];
+    char path[256];
+    char referer[128];
+    char agent[128];
+
+    // 填写请求的字段，start为开始处理的时间(NowNs)
+    void Fill(int64_t start, uint32_t addr, std::string_view m, std::string_view p, std::string_view v,
+              std::string_view ref, std::string_view ua);
+};
+
+class AccessLog {
+public:
+    static AccessLog* Instance();
+    static int64_t NowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    // 写到path目录下按天切换的access_日期.log，每sampleN个请求记1个(4xx、5xx总是记录)，0为关闭
+    // 每个线程的缓冲区大约容纳capacity条记录
+    void Init(const char* path, int sampleN, int capacity = 1024);
+    bool IsOpen() const { return sampleN_.load(std::memory_order_relaxed) > 0; }
+    // 是否记录这个请求，抽样计数按线程分开，不争用
+    bool Sample(int status) {
+        int n = sampleN_.load(std::memory_order_relaxed);
+        if(n <= 0) { return false; }
+        thread_local uint32_t count = 0;
+        return status >= 400 || n == 1 || count++ % n == 0;
+    }
+    // 响应发完后提交，缓冲区满时丢弃并计数
+    void Append(const AccessRecord& rec);
+    // 等待写线程把调用前提交的记录全部写出(最多1秒)
+    void Flush();
+    uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    AccessLog();
+    ~AccessLog();
+
+    LogRing* LocalRing_();
+    void WriteThread_();
+    // 取出所有缓冲区的记录写入文件，返回取出的条数
+    size_t Drain_();
+    void WriteBatch_();
+    // 日期变化时切换文件
+    void OpenFile_(time_t sec);
+    // 格式化一条记录，返回长度
+    size_t Format_(char* buf, size_t size, const AccessRecord& rec);
+    // 追加带引号的字符串，引号、反斜杠和控制字符转义成\xHH
+    static size_t Quote_(char* buf, size_t size, const char* s);
+
+    static constexpr int LINE_LEN = 4096;           // 单行最大长度，字段全部转义时也放得下
+    static constexpr int BATCH_BUF = 64 * 1024;     // 攒一批的缓冲区
+    static constexpr int FLUSH_MS = 100;            // 没有被叫醒时的写出间隔
+
+    std::atomic<int> sampleN_;
+    std::string path_;
+    size_t ringSize_;
+    int fd_;
+    int day_;                                   // 当前文件的日期(yyyymmdd)
+    time_t lastSec_;                            // 时间前缀的缓存
+    char date_[64];
+    std::unique_ptr<char[]> buf_;
+    size_t used_;
+    std::mutex fileMtx_;                        // 保护path_和文件，Init可能和写线程同时进行
+
+    std::vector<std::unique_ptr<LogRing>> rings_;
+    std::mutex ringsMtx_;
+    std::unique_ptr<std::thread> writeThread_;
+    std::atomic<bool> stop_;
+    std::atomic<bool> wakeup_;
+    std::atomic<uint64_t> flushReq_;
+    std::atomic<uint64_t> flushDone_;
+    std::mutex condMtx_;
+    std::condition_variable cond_;
+    std::condition_variable flushCond_;
+    std::atomic<uint64_t> dropped_;
+};
+
+#endif //ACCESS_LOG_H
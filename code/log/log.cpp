@@ -1,34 +1,120 @@
 #include "log.h"
+#include <sys/resource.h>     // setpriority
+#include <sys/syscall.h>      // ioprio_set
+#include <zlib.h>
+
+using namespace std;
 
 // 构造函数
 Log::Log() {
-    fp_ = nullptr;
-    deque_ = nullptr;
+    fd_ = -1;
     writeThread_ = nullptr;
-    lineCount_ = 0;
-    toDay_ = 0;
+    maxBytes_ = 128 * 1024 * 1024;
+    periodSec_ = 86400;
+    compress_ = true;
+    fsync_ = FSYNC_ROTATE;
+    fsyncMS_ = 1000;
+    period_[0] = '\0';
+    periodEnd_ = 0;
+    fileIdx_ = 0;
+    fileBytes_ = 0;
+    dirty_ = false;
+    lastSync_ = 0;
+    level_ = 1;
     isAsync_ = false;
+    deferred_ = false;
+    isOpen_ = false;
+    ringSize_ = 0;
+    stop_ = false;
+    sleeping_ = false;
+    wakeup_ = false;
+    flushReq_ = 0;
+    flushDone_ = 0;
+    dropped_ = 0;
+    droppedBytes_ = 0;
+    lines_ = 0;
+    bytes_ = 0;
+    blocked_ = 0;
+    overflow_ = DROP_NEWEST;
+    blockMS_ = 10;
+    waiters_ = 0;
+    for(auto& site: sites_) {
+        site = nullptr;
+    }
+    siteCount_ = 0;
+    fmtUsed_ = 0;
+    baseTicks_ = 0;
+    baseNs_ = 0;
+    nsPerTick_ = 1.0;
+    zipStop_ = false;
+    zipping_ = false;
+    lastReport_ = 0;
 }
 
 Log::~Log() {
-    while(!deque_->empty()) {
-        deque_->flush();    // 唤醒消费者，处理掉剩下的任务
+    if(writeThread_ && writeThread_->joinable()) {  // 未初始化或同步模式下没有写线程
+        stop_ = true;
+        cond_.notify_one();
+        writeThread_->join();   // 写线程取完所有缓冲区后退出
+    }
+    {
+        lock_guard<mutex> locker(fileMtx_);
+        CloseFile_(false);      // 关闭日志文件，重启后继续追加，不压缩
     }
-    deque_->Close();    // 关闭队列
-    writeThread_->join();   // 等待当前线程完成手中的任务
-    if(fp_) {               // 冲洗文件缓冲区，关闭文件描述符
-        lock_guard<mutex> locker(mtx_);
-        flush();        // 清空缓冲区中的数据
-        fclose(fp_);    // 关闭日志文件
+    if(zipThread_) {
+        {
+            lock_guard<mutex> locker(zipMtx_);
+            zipStop_ = true;
+        }
+        zipCond_.notify_one();
+        zipThread_->join();     // 压缩完队列里剩下的文件再退出
     }
 }
 
-// 唤醒阻塞队列消费者，开始写日志
+void Log::SetRotate(size_t maxBytes, int periodSec, bool compress) {
+    lock_guard<mutex> locker(fileMtx_);
+    maxBytes_ = maxBytes > 0 ? maxBytes : 1;
+    periodSec_ = (periodSec > 0 && periodSec < 86400) ? periodSec : 86400;
+    compress_ = compress;
+    periodEnd_ = 0;         // 下一次写入时按新的周期重新计算
+}
+
+void Log::SetFsync(FSYNC_POLICY policy, int intervalMS) {
+    lock_guard<mutex> locker(fileMtx_);
+    fsync_ = policy;
+    fsyncMS_ = intervalMS;
+}
+
+void Log::SetOverflow(OVERFLOW_POLICY policy, int blockMS) {
+    overflow_.store(policy, memory_order_relaxed);
+    blockMS_.store(blockMS, memory_order_relaxed);
+}
+
+Log::Stats Log::GetStats() const {
+    Stats stats;
+    stats.lines = lines_.load(memory_order_relaxed);
+    stats.bytes = bytes_.load(memory_order_relaxed);
+    stats.droppedLines = dropped_.load(memory_order_relaxed);
+    stats.droppedBytes = droppedBytes_.load(memory_order_relaxed);
+    stats.blocked = blocked_.load(memory_order_relaxed);
+    return stats;
+}
+
+bool Log::WaitCompress(int timeoutMS) {
+    unique_lock<mutex> locker(zipMtx_);
+    return zipCond_.wait_for(locker, chrono::milliseconds(timeoutMS),
+                             [this]() { return zipQueue_.empty() && !zipping_; });
+}
+
+// 异步模式下等待写线程处理完当前所有缓冲区，最多等1秒，保证不会因写线程异常而卡住调用方
 void Log::flush() {
-    if(isAsync_) {  // 只有异步日志才会用到deque
-        deque_->flush();
+    if(!isAsync_ || !writeThread_) {
+        return;     // 同步模式直接write，没有用户态缓冲
     }
-    fflush(fp_);    // 清空输入缓冲区
+    uint64_t req = ++flushReq_;
+    unique_lock<mutex> locker(condMtx_);
+    cond_.notify_one();
+    flushCond_.wait_for(locker, chrono::seconds(1), [this, req]() { return flushDone_.load() >= req; });
 }
 
 // 懒汉模式 局部静态变量法（这种方法不需要加锁和解锁操作）
@@ -45,163 +131,635 @@ void Log::FlushLogThread() {
     Log::Instance()->AsyncWrite_();
 }
 
-// 写线程真正的执行函数
+// 写线程真正的执行函数：取完所有缓冲区，没有日志时最多睡50ms
 void Log::AsyncWrite_() {
-    // 从队列中获取日志信息
-    string str = "";
-    while(deque_->pop(str)) {
-        // 上锁
-        lock_guard<mutex> locker(mtx_);
-        // 将日志信息写入文件
-        fputs(str.c_str(), fp_);
+    fmtBuf_.reset(new char[FMT_BUF]);
+    while(true) {
+        uint64_t req = flushReq_.load();
+        Calibrate_(false);
+        size_t bytes = Drain_();
+        EmitSuppressed_(false);
+        if(flushDone_.load() < req) {
+            lock_guard<mutex> locker(condMtx_);
+            flushDone_ = req;
+            flushCond_.notify_all();
+        }
+        if(bytes > 0) {
+            continue;
+        }
+        {
+            lock_guard<mutex> locker(fileMtx_);
+            SyncIfNeeded_();    // 空闲时也按间隔刷盘
+        }
+        if(stop_) {
+            EmitSuppressed_(true);  // 退出前把还没汇总的也写出
+            break;
+        }
+        unique_lock<mutex> locker(condMtx_);
+        sleeping_ = true;
+        cond_.wait_for(locker, chrono::milliseconds(50),
+                       [this]() { return stop_ || wakeup_ || flushReq_.load() != flushDone_.load(); });
+        sleeping_ = false;
+        wakeup_ = false;
+    }
+}
+
+LogRing* Log::LocalRing_() {
+    // 线程退出时只做标记，缓冲区里剩下的日志由写线程取完后再释放
+    struct Holder {
+        LogRing* ring = nullptr;
+        ~Holder() { if(ring) { ring->Detach(); } }
+    };
+    thread_local Holder holder;
+    if(!holder.ring) {
+        unique_ptr<LogRing> ring(new LogRing(ringSize_));
+        holder.ring = ring.get();
+        lock_guard<mutex> locker(ringsMtx_);
+        rings_.push_back(move(ring));
+    }
+    return holder.ring;
+}
+
+size_t Log::Drain_() {
+    vector<LogRing*> rings;
+    {
+        lock_guard<mutex> locker(ringsMtx_);
+        for(size_t i = 0; i < rings_.size();) {
+            if(rings_[i]->Detached() && rings_[i]->Used() == 0) {
+                rings_[i] = move(rings_.back());    // 线程已经退出且取完
+                rings_.pop_back();
+                continue;
+            }
+            rings.push_back(rings_[i].get());
+            i++;
+        }
+    }
+    // 延迟记录先整条拷出，确认没有被DROP_OLDEST丢弃后再格式化
+    static thread_local char rec[LINE_LEN];
+    size_t total = 0;
+    lock_guard<mutex> locker(fileMtx_);
+    for(LogRing* ring: rings) {
+        size_t pos;
+        uint32_t tag, len;
+        const char* data;
+        size_t popped = 0;
+        while(ring->Front(pos, tag, data, len)) {
+            if(fmtUsed_ + LINE_LEN > FMT_BUF) {
+                NotifySpace_();
+                WriteBatch_();
+            }
+            size_t n = min(static_cast<size_t>(len), static_cast<size_t>(LINE_LEN));
+            char* line = fmtBuf_.get() + fmtUsed_;
+            if(tag == LogRing::TEXT) {
+                memcpy(line, data, n);
+            } else if(tag == LogRing::DEFERRED) {
+                memcpy(rec, data, n);
+            }
+            if(!ring->Pop(pos, len)) {
+                continue;   // 拷贝期间被生产者丢弃，内容可能已被覆盖
+            }
+            popped += len;
+            if(tag == LogRing::DEFERRED && n >= DEFERRED_HEAD) {
+                n = FormatDeferred_(line, LINE_LEN, rec, n);
+            } else if(tag != LogRing::TEXT) {
+                continue;
+            }
+            fmtUsed_ += n;
+            lines_.fetch_add(1, memory_order_relaxed);
+        }
+        if(popped) {
+            total += popped;
+            NotifySpace_();
+        }
     }
+    WriteBatch_();
+    return total;
+}
+
+// 所有行都在fmtBuf_中连续存放，一次write写出
+void Log::WriteBatch_() {
+    if(fmtUsed_ == 0) {
+        return;
+    }
+    RotateIfNeeded_(fmtUsed_);      // 一批只写进一个文件
+    fileBytes_ += fmtUsed_;
+    bytes_.fetch_add(fmtUsed_, memory_order_relaxed);
+    dirty_ = true;
+    const char* p = fmtBuf_.get();
+    size_t left = fmtUsed_;
+    while(left > 0) {
+        ssize_t len = ::write(fd_, p, left);
+        if(len < 0) {
+            if(errno == EINTR) { continue; }
+            break;      // 磁盘满等错误时丢弃这一批
+        }
+        p += len;       // 普通文件一般一次写完，部分写入时接着写剩下的
+        left -= len;
+    }
+    fmtUsed_ = 0;
+    SyncIfNeeded_();
 }
 
 // 初始化日志实例
-void Log::init(int level, const char* path, const char* suffix, int maxQueCapacity) {
+void Log::init(int level, const char* path, const char* suffix, int maxQueCapacity, bool deferred) {
     // 是否打开日志
     isOpen_ = true;
     // 日志级别
-    level_ = level;
-    // 日志路径
-    path_ = path;
-    // 日志后缀
-    suffix_ = suffix;
+    SetLevel(level);
+    {
+        lock_guard<mutex> locker(fileMtx_);     // 写线程可能已经在运行
+        // 日志路径
+        path_ = path;
+        // 日志后缀
+        suffix_ = suffix;
+        CloseFile_(false);
+        periodEnd_ = 0;     // 按当前时间重新打开文件
+        RotateIfNeeded_(0);
+    }
     if(maxQueCapacity) {    // 异步方式
+        // 每条记录都按LINE_LEN预留，而环形缓冲区只接受不超过一半容量的记录，容量再小也要放得下两行
+        ringSize_ = max(static_cast<size_t>(maxQueCapacity) * AVG_LINE, 2 * (LINE_LEN + LogRing::HEADER));
         isAsync_ = true;
-        if(!deque_) {   // 为空则创建一个
-            unique_ptr<BlockQueue<std::string>> newQue(new BlockQueue<std::string>);
-            // 因为unique_ptr不支持普通的拷贝或赋值操作,所以采用move
-            // 将动态申请的内存权给deque，newDeque被释放
-            deque_ = move(newQue);  // 左值变右值,掏空newDeque
-            unique_ptr<thread> newThread(new thread(FlushLogThread));
-            writeThread_ = move(newThread);
+        if(!writeThread_) {
+            Calibrate_(true);   // 写线程启动前完成，之后只由写线程修改
+            writeThread_.reset(new thread(FlushLogThread));
         }
+        deferred_ = deferred;
     } else {
         isAsync_ = false;
+        deferred_ = false;
     }
+}
 
-    // 初始化日志文件行数
-    lineCount_ = 0;
-    // 获取当前时间
-    time_t timer = time(nullptr);
-    // 将当前时间转换为tm结构体
-    struct tm* systime = localtime(&timer);
-    // 定义日志文件名
-    char fileName[LOG_NAME_LEN] = {0};
-    // 生成日志文件名
-    snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", 
-            path_, systime->tm_year + 1900, systime->tm_mon + 1, systime->tm_mday, suffix_);
-    // 记录当前日志文件名
-    toDay_ = systime->tm_mday;
+// 周期内的文件依次为 日期.log、日期-1.log ...，已经压缩过或写满的编号跳过，重启后接着上次的文件写
+void Log::OpenFile_() {
+    char fileName[LOG_NAME_LEN];
+    struct stat st;
+    for(;; fileIdx_++) {
+        if(fileIdx_ == 0) {
+            snprintf(fileName, LOG_NAME_LEN - 8, "%s/%s%s", path_, period_, suffix_);
+        } else {
+            snprintf(fileName, LOG_NAME_LEN - 8, "%s/%s-%d%s", path_, period_, fileIdx_, suffix_);
+        }
+        string gz = string(fileName) + ".gz";
+        if(stat(gz.c_str(), &st) == 0) { continue; }
+        if(stat(fileName, &st) == 0 && static_cast<size_t>(st.st_size) >= maxBytes_) { continue; }
+        break;
+    }
+    fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd_ < 0) {
+        mkdir(path_, 0777); // 创建文件夹
+        fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    assert(fd_ >= 0);
+    fileBytes_ = (fstat(fd_, &st) == 0) ? st.st_size : 0;
+    fileName_ = fileName;
+}
 
+void Log::CloseFile_(bool rotated) {
+    if(fd_ < 0) {
+        return;
+    }
+    if(fsync_ != FSYNC_NEVER && dirty_) {
+        fdatasync(fd_);
+    }
+    close(fd_);
+    fd_ = -1;
+    dirty_ = false;
+    if(!rotated || !compress_ || fileBytes_ == 0) {
+        return;
+    }
     {
-        lock_guard<mutex> locker(mtx_);
-        buff_.RetrieveAll(); // 把缓冲区中的数据全部取出来
-        if(fp_) {   // 重新打开
-            flush();    
-            fclose(fp_); // 关闭文件
+        lock_guard<mutex> locker(zipMtx_);
+        zipQueue_.push_back(fileName_);
+    }
+    if(!zipThread_) {
+        zipThread_.reset(new thread([this]() { ZipThread_(); }));
+    }
+    zipCond_.notify_one();
+}
+
+void Log::RotateIfNeeded_(size_t incoming) {
+    time_t now = time(nullptr);
+    bool timeUp = fd_ < 0 || now >= periodEnd_;
+    if(!timeUp && (fileBytes_ == 0 || fileBytes_ + incoming <= maxBytes_)) {
+        return;
+    }
+    if(timeUp) {
+        // 从本地零点起按周期对齐，每天最后一个周期截止到零点
+        struct tm t;
+        localtime_r(&now, &t);
+        int sinceMidnight = t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec;
+        int start = sinceMidnight / periodSec_ * periodSec_;
+        periodEnd_ = now - sinceMidnight + min(start + periodSec_, 86400);
+        if(periodSec_ >= 86400) {
+            snprintf(period_, sizeof(period_), "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+        } else {
+            snprintf(period_, sizeof(period_), "%04d_%02d_%02d_%02d%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                     start / 3600, start % 3600 / 60);
         }
-        fp_ = fopen(fileName, "a"); // 打开文件读取并附加写入       
-        if(fp_ == nullptr) {
-            mkdir(path_, 0777); // 创建文件夹
-            fp_ = fopen(fileName, "a"); // 打开文件读取并附加写入
+        fileIdx_ = 0;
+    } else {
+        fileIdx_++;
+    }
+    CloseFile_(fd_ >= 0);
+    OpenFile_();
+}
+
+void Log::SyncIfNeeded_() {
+    if(!dirty_ || fd_ < 0) {
+        return;
+    }
+    if(fsync_ == FSYNC_BATCH) {
+        fdatasync(fd_);
+        dirty_ = false;
+    } else if(fsync_ == FSYNC_INTERVAL) {
+        int64_t now = RealNs_() / 1000000;
+        if(now - lastSync_ >= fsyncMS_) {
+            fdatasync(fd_);
+            dirty_ = false;
+            lastSync_ = now;
         }
-        assert(fp_ != nullptr); // 断言文件指针不为空
     }
 }
 
-void Log::write(int level, const char *format, ...) { 
+// 压缩线程：调低CPU和IO优先级，不和写线程、工作线程抢资源
+void Log::ZipThread_() {
+    setpriority(PRIO_PROCESS, 0, 19);   // Linux上只作用于当前线程
+#ifdef SYS_ioprio_set
+    syscall(SYS_ioprio_set, 1, 0, 3 << 13);     // IOPRIO_WHO_PROCESS, 当前线程, IOPRIO_CLASS_IDLE
+#endif
+    unique_lock<mutex> locker(zipMtx_);
+    while(true) {
+        zipCond_.wait(locker, [this]() { return zipStop_ || !zipQueue_.empty(); });
+        if(zipQueue_.empty()) {
+            break;      // 只在队列空了以后才退出
+        }
+        string path = move(zipQueue_.front());
+        zipQueue_.pop_front();
+        zipping_ = true;
+        locker.unlock();
+        Gzip_(path);
+        locker.lock();
+        zipping_ = false;
+        zipCond_.notify_all();      // 通知WaitCompress
+    }
+}
 
+bool Log::Gzip_(const string& path) {
+    int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(in < 0) {
+        return false;
+    }
+    string tmp = path + ".gz.tmp";
+    gzFile out = gzopen(tmp.c_str(), "wb6");
+    bool ok = out != nullptr;
+    unique_ptr<char[]> buf(new char[64 * 1024]);
+    ssize_t n = 0;
+    while(ok && (n = read(in, buf.get(), 64 * 1024)) > 0) {
+        ok = gzwrite(out, buf.get(), static_cast<unsigned>(n)) == n;
+    }
+    close(in);
+    if(n < 0) { ok = false; }
+    if(out && gzclose(out) != Z_OK) { ok = false; }
+    // 先写临时文件再改名，中途失败时原文件保留
+    if(ok && rename(tmp.c_str(), (path + ".gz").c_str()) == 0) {
+        unlink(path.c_str());
+        return true;
+    }
+    unlink(tmp.c_str());
+    return false;
+}
+
+// 时间精确到微秒，日期部分每秒只格式化一次
+size_t Log::FormatPrefix_(char* buf, size_t size, int level, time_t sec, long usec) {
+    static const char* TITLE[] = { "[debug]: ", "[info] : ", "[warn] : ", "[error]: " };
+    thread_local time_t lastSec = -1;
+    thread_local char date[64];
+    if(sec != lastSec) {
+        struct tm t;
+        localtime_r(&sec, &t);
+        snprintf(date, sizeof(date), "%d-%02d-%02d %02d:%02d:%02d",
+                 t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+        lastSec = sec;
+    }
+    return snprintf(buf, size, "%s.%06ld %s", date, usec, TITLE[(level >= 0 && level <= 3) ? level : 1]);
+}
+
+size_t Log::FormatLine_(char* buf, size_t size, int level, const char* format, va_list vaList) {
     struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);    //获取时间和时区 nullptr不返回时区信息
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);  
-    struct tm t = *sysTime;
+    gettimeofday(&now, nullptr);
+    size_t n = FormatPrefix_(buf, size, level, now.tv_sec, now.tv_usec);
+    int m = vsnprintf(buf + n, size - n - 1, format, vaList);
+    size_t len = n + (m < 0 ? 0 : min(static_cast<size_t>(m), size - n - 2));     // 截断时vsnprintf返回的是完整长度
+    buf[len++] = '\n';
+    return len;
+}
 
-    va_list vaList;
+int64_t Log::RealNs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
 
-    // 日志日期 日志行数  如果不是今天或行数超了
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
-    {
-        unique_lock<mutex> locker(mtx_);
-        locker.unlock();
-        
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+void Log::Calibrate_(bool init) {
+    uint64_t ticks = Ticks_();
+    int64_t ns = RealNs_();
+    if(init) {
+        // 忙等10ms测出每个计数的纳秒数
+        int64_t end = ns + 10000000;
+        uint64_t t;
+        int64_t now;
+        do {
+            t = Ticks_();
+            now = RealNs_();
+        } while(now < end);
+        nsPerTick_ = static_cast<double>(now - ns) / static_cast<double>(t - ticks);
+        baseTicks_ = t;
+        baseNs_ = now;
+        return;
+    }
+    if(ns - baseNs_ < 1000000000) {
+        return;
+    }
+    if(ticks > baseTicks_) {
+        // 用最近一秒的实际间隔修正频率，墙上时间被调整时也只影响这一秒
+        double rate = static_cast<double>(ns - baseNs_) / static_cast<double>(ticks - baseTicks_);
+        if(rate > nsPerTick_ * 0.5 && rate < nsPerTick_ * 2) {
+            nsPerTick_ = rate;
+        }
+    }
+    baseTicks_ = ticks;
+    baseNs_ = ns;
+}
 
-        if (toDay_ != t.tm_mday)    // 时间不匹配，则替换为最新的日志文件名
-        {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
+int64_t Log::TicksToNs_(uint64_t ticks) const {
+    // 记录可能早于基准，差值按有符号数处理
+    return baseNs_ + static_cast<int64_t>(static_cast<double>(static_cast<int64_t>(ticks - baseTicks_)) * nsPerTick_);
+}
+
+size_t Log::FormatDeferred_(char* buf, size_t size, const char* rec, size_t len) {
+    uint32_t head[2];
+    uint64_t ticks;
+    memcpy(head, rec, 8);
+    memcpy(&ticks, rec + 8, 8);
+    int64_t ns = TicksToNs_(ticks);
+    const LogSite* site = head[1] < static_cast<uint32_t>(MAX_SITES) ?
+                          sites_[head[1]].load(memory_order_acquire) : nullptr;
+    size_t n = FormatPrefix_(buf, size, static_cast<int>(head[0]),
+                             static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000 / 1000));
+    if(site) {
+        n += FormatArgs_(buf + n, size - n - 1, site->format, rec + DEFERRED_HEAD, len - DEFERRED_HEAD);
+    }
+    buf[n++] = '\n';
+    return n;
+}
+
+// 逐个转换说明符解析格式串，去掉长度修饰后按参数的编码类型补上对应的修饰再交给snprintf
+size_t Log::FormatArgs_(char* buf, size_t size, const char* format, const char* args, size_t len) {
+    const char* argEnd = args + len;
+    // 取下一个参数，没有了返回false
+    auto next = [&args, argEnd](uint8_t& type, uint64_t& bits, const char*& str, uint32_t& strLen) {
+        // 长度不对的参数(被截断的记录)视为没有
+        if(args >= argEnd) { return false; }
+        type = static_cast<uint8_t>(*args);
+        if(type == LogArgWriter::STR) {
+            if(argEnd - args < 5) { args = argEnd; return false; }
+            memcpy(&strLen, args + 1, 4);
+            if(strLen > static_cast<size_t>(argEnd - args - 5)) { args = argEnd; return false; }
+            str = args + 5;
+            args += 5 + strLen;
+        } else {
+            if(argEnd - args < 9) { args = argEnd; return false; }
+            memcpy(&bits, args + 1, 8);
+            args += 9;
         }
-        else {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_  / MAX_LINES), suffix_);
+        return true;
+    };
+    size_t n = 0;
+    const char* p = format;
+    while(*p && n + 1 < size) {
+        if(*p != '%') {
+            buf[n++] = *p++;
+            continue;
         }
-        
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");          
-        assert(fp_ != nullptr);
+        if(p[1] == '%') {
+            buf[n++] = '%';
+            p += 2;
+            continue;
+        }
+        char spec[32];
+        size_t k = 0;
+        spec[k++] = *p++;
+        // 标志、宽度、精度，*从参数中取值
+        while(*p && strchr("-+ #0123456789.*", *p) && k < sizeof(spec) - 8) {
+            if(*p == '*') {
+                uint8_t type; uint64_t bits = 0; const char* str; uint32_t strLen;
+                int v = next(type, bits, str, strLen) && type != LogArgWriter::STR ? static_cast<int>(bits) : 0;
+                k += snprintf(spec + k, sizeof(spec) - k, "%d", v);
+                p++;
+                continue;
+            }
+            spec[k++] = *p++;
+        }
+        while(*p && strchr("hlLqjzt", *p)) { p++; }     // 长度修饰按实际参数类型重新生成
+        char conv = *p;
+        if(!conv) { break; }
+        p++;
+        uint8_t type;
+        uint64_t bits = 0;
+        const char* str = nullptr;
+        uint32_t strLen = 0;
+        if(conv == 'n' || !next(type, bits, str, strLen)) {
+            continue;       // 参数不够时该处留空
+        }
+        int64_t ival = static_cast<int64_t>(bits);
+        double dval;
+        memcpy(&dval, &bits, 8);
+        if(type == LogArgWriter::DOUBLE) { ival = static_cast<int64_t>(dval); }
+        else { dval = (type == LogArgWriter::INT) ? static_cast<double>(ival) : static_cast<double>(bits); }
+        int m = 0;
+        char* out = buf + n;
+        size_t room = size - n;
+        if(conv == 's') {
+            if(type == LogArgWriter::STR) {
+                spec[k] = '\0';
+                const char* dot = strchr(spec, '.');
+                if(dot && static_cast<uint32_t>(atoi(dot + 1)) < strLen) { strLen = atoi(dot + 1); }
+                if(dot) { k = dot - spec; }
+                memcpy(spec + k, ".*s", 4);     // 字符串没有结尾的'\0'，用精度限定长度
+                m = snprintf(out, room, spec, static_cast<int>(strLen), str);
+            } else {
+                m = snprintf(out, room, "%lld", static_cast<long long>(ival));
+            }
+        } else if(strchr("fFeEgGaA", conv)) {
+            memcpy(spec + k, &conv, 1);
+            spec[k + 1] = '\0';
+            m = snprintf(out, room, spec, dval);
+        } else if(conv == 'p') {
+            memcpy(spec + k, "p", 2);
+            m = snprintf(out, room, spec, reinterpret_cast<void*>(static_cast<uintptr_t>(bits)));
+        } else if(type == LogArgWriter::STR) {
+            m = snprintf(out, room, "%.*s", static_cast<int>(strLen), str);     // 类型不符时原样输出字符串
+        } else if(strchr("diouxXc", conv)) {
+            spec[k] = 'l';
+            spec[k + 1] = 'l';
+            spec[k + 2] = (conv == 'c') ? 'd' : conv;
+            spec[k + 3] = '\0';
+            if(conv == 'c') {
+                m = snprintf(out, room, "%c", static_cast<char>(ival));
+            } else {
+                m = snprintf(out, room, spec, static_cast<long long>(ival));
+            }
+        }
+        if(m > 0) { n += min(static_cast<size_t>(m), room - 1); }
     }
+    buf[n] = '\0';
+    return n;
+}
 
-    // 在buffer内生成一条对应的日志信息 
-    {
-        unique_lock<mutex> locker(mtx_);
-        lineCount_++;
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                    t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-                    
-        buff_.HasWritten(n);
-        AppendLogLevelTitle_(level);    
+void Log::RegisterLimiter(LogLimiter* limiter) {
+    lock_guard<mutex> locker(limitersMtx_);
+    limiters_.push_back(limiter);
+}
 
-        va_start(vaList, format);
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
-        va_end(vaList);
+void Log::ReportSuppressed(LogLimiter* limiter) {
+    if(isAsync_ && writeThread_) {
+        return;     // 由写线程定期汇总
+    }
+    uint64_t count = limiter->Suppressed() ? limiter->TakeSuppressed() : 0;
+    if(count) {
+        char buf[256];
+        size_t len = FormatSuppressed_(buf, sizeof(buf), limiter, count);
+        lock_guard<mutex> locker(fileMtx_);
+        RotateIfNeeded_(len);
+        if(::write(fd_, buf, len) > 0) {
+            fileBytes_ += len;
+            dirty_ = true;
+        }
+    }
+}
 
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2);
+size_t Log::FormatSuppressed_(char* buf, size_t size, const LogLimiter* limiter, uint64_t count) {
+    struct timeval now = {0, 0};
+    gettimeofday(&now, nullptr);
+    const char* file = strrchr(limiter->File(), '/');
+    size_t n = FormatPrefix_(buf, size, limiter->Level(), now.tv_sec, now.tv_usec);
+    int m = snprintf(buf + n, size - n - 1, "suppressed %llu similar messages from %s:%d",
+                     static_cast<unsigned long long>(count), file ? file + 1 : limiter->File(), limiter->Line());
+    n += min(static_cast<size_t>(m > 0 ? m : 0), size - n - 2);
+    buf[n++] = '\n';
+    return n;
+}
 
-        if(isAsync_ && deque_ && !deque_->full()) { // 异步方式（加入阻塞队列中，等待写线程读取日志信息）
-            deque_->push_back(buff_.RetrieveAllToStr());
-        } else {    // 同步方式（直接向文件中写入日志信息）
-            fputs(buff_.Peek(), fp_);   // 同步就直接写入文件
+void Log::EmitSuppressed_(bool force) {
+    int64_t now = RealNs_() / 1000000;
+    if(!force && now - lastReport_ < SUPPRESS_REPORT_MS) {
+        return;
+    }
+    lastReport_ = now;
+    {
+        lock_guard<mutex> locker(limitersMtx_);
+        for(LogLimiter* limiter: limiters_) {
+            if(!limiter->Suppressed() || fmtUsed_ + LINE_LEN > FMT_BUF) {
+                continue;
+            }
+            fmtUsed_ += FormatSuppressed_(fmtBuf_.get() + fmtUsed_, LINE_LEN, limiter, limiter->TakeSuppressed());
+            lines_.fetch_add(1, memory_order_relaxed);
         }
-        buff_.RetrieveAll();    // 清空buff
+    }
+    if(fmtUsed_ > 0) {
+        lock_guard<mutex> locker(fileMtx_);
+        WriteBatch_();
     }
 }
 
-// 添加日志等级
-void Log::AppendLogLevelTitle_(int level) {
-    switch(level) {
-    case 0:
-        buff_.Append("[debug]: ", 9);
-        break;
-    case 1:
-        buff_.Append("[info] : ", 9);
-        break;
-    case 2:
-        buff_.Append("[warn] : ", 9);
-        break;
-    case 3:
-        buff_.Append("[error]: ", 9);
-        break;
-    default:
-        buff_.Append("[info] : ", 9);
-        break;
+int Log::RegisterSite(const LogSite* site) {
+    int id = siteCount_.fetch_add(1, memory_order_relaxed);
+    if(id >= MAX_SITES) {
+        return -1;
     }
+    sites_[id].store(site, memory_order_release);
+    return id;
 }
 
-int Log::GetLevel() {
-    lock_guard<mutex> locker(mtx_);
-    return level_;
+void Log::WakeWriter_(LogRing* ring) {
+    // 超过一半才提前叫醒写线程，先置标志再通知，写线程检查条件时不会漏掉
+    if(ring->ProducerUsed() > ring->Capacity() / 2 && ring->Used() > ring->Capacity() / 2
+       && sleeping_.load(memory_order_relaxed) && !wakeup_.load(memory_order_relaxed) && !wakeup_.exchange(true)) {
+        cond_.notify_one();
+    }
 }
 
-void Log::SetLevel(int level) {
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
+char* Log::ReserveSlow_(LogRing* ring) {
+    OVERFLOW_POLICY policy = overflow_.load(memory_order_relaxed);
+    if(policy == DROP_OLDEST) {
+        uint64_t lines = 0;
+        size_t bytes = ring->DropOldest(LINE_LEN, lines);
+        if(lines) {
+            dropped_.fetch_add(lines, memory_order_relaxed);
+            droppedBytes_.fetch_add(bytes, memory_order_relaxed);
+        }
+        return ring->Reserve(LINE_LEN);
+    }
+    if(policy != BLOCK) {
+        return nullptr;
+    }
+    blocked_.fetch_add(1, memory_order_relaxed);
+    {
+        lock_guard<mutex> locker(condMtx_);
+        wakeup_ = true;
+    }
+    cond_.notify_one();
+    // 写线程每取完一个缓冲区就通知，这里只等空间，不碰文件
+    char* buf = nullptr;
+    unique_lock<mutex> locker(spaceMtx_);
+    waiters_.fetch_add(1);
+    spaceCond_.wait_for(locker, chrono::milliseconds(blockMS_.load(memory_order_relaxed)),
+                        [&]() { return (buf = ring->Reserve(LINE_LEN)) != nullptr; });
+    waiters_.fetch_sub(1);
+    return buf;
+}
+
+char* Log::DropBuf_() {
+    thread_local unique_ptr<char[]> buf(new char[LINE_LEN]);
+    return buf.get();
+}
+
+void Log::NotifySpace_() {
+    if(waiters_.load() > 0) {
+        { lock_guard<mutex> locker(spaceMtx_); }    // 等待方检查条件和进入等待之间不会漏掉通知
+        spaceCond_.notify_all();
+    }
+}
+
+void Log::write(int level, const char *format, ...) {
+    va_list vaList;
+    va_start(vaList, format);
+    if(isAsync_ && writeThread_) {
+        // 直接格式化到本线程的缓冲区，满了按溢出策略处理，除BLOCK外不等待也不加锁
+        LogRing* ring = LocalRing_();
+        char* buf = ring->Reserve(LINE_LEN);
+        if(!buf) {
+            buf = ReserveSlow_(ring);
+        }
+        if(!buf) {
+            // 缓冲区满正是过载的时候，丢弃的行不再格式化，字节数按格式串长度估算
+            CountDropped_(strlen(format));
+        } else {
+            ring->Commit(LogRing::TEXT, FormatLine_(buf, LINE_LEN, level, format, vaList));
+            WakeWriter_(ring);
+        }
+    } else {    // 同步方式（直接向文件中写入日志信息）
+        char buf[LINE_LEN];
+        size_t len = FormatLine_(buf, LINE_LEN, level, format, vaList);
+        lock_guard<mutex> locker(fileMtx_);
+        RotateIfNeeded_(len);
+        if(::write(fd_, buf, len) > 0) {    // 写失败时丢弃这一行
+            fileBytes_ += len;
+            dirty_ = true;
+            SyncIfNeeded_();
+        }
+    }
+    va_end(vaList);
 }
@@ -4,75 +4,323 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <sys/time.h>
 #include <string.h>
 #include <stdarg.h>           // vastart va_end
 #include <assert.h>
+#include <fcntl.h>            // open
+#include <unistd.h>           // write, close
 #include <sys/stat.h>         // mkdir
-#include "blockqueue.h"
-#include "../buffer/buffer.h"
+#include <time.h>             // clock_gettime
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>        // __rdtsc
+#endif
+#include "logring.h"
+#include "logarg.h"
+#include "loglimiter.h"
 
+/*
+日志
+异步模式下每个线程把格式化好的行写进自己的环形缓冲区(LogRing)，不加锁也不做文件IO，缓冲区满时按溢出策略处理并计数；
+一个写线程轮询所有缓冲区，把记录拷出后成批写入文件，日志文件的打开、切换、刷盘也只在写线程中进行
+文件按大小和时间周期切换，切换下来的文件由一个低优先级线程gzip压缩
+同步模式下直接在调用线程加锁写文件
+延迟格式化模式(异步时默认开启)下调用点只记录格式串编号、时间戳和原始参数，格式化也交给写线程
+*/
 class Log {
 public:
-    // 初始化日志实例（阻塞队列最大容量、日志保存路径、日志文件后缀）
-    void init(int level, const char* path = "./log", 
+    enum FSYNC_POLICY {
+        FSYNC_NEVER = 0,    // 交给内核
+        FSYNC_ROTATE,       // 切换或关闭文件时
+        FSYNC_INTERVAL,     // 距上次刷盘超过间隔时
+        FSYNC_BATCH,        // 每批写完(组提交)
+    };
+
+    // 异步模式下线程缓冲区满时的处理
+    enum OVERFLOW_POLICY {
+        DROP_NEWEST = 0,    // 丢弃新写的这一行
+        DROP_OLDEST,        // 丢弃缓冲区里最早的行，保留最近的
+        BLOCK,              // 等写线程腾出空间，超时后丢弃新行
+    };
+
+    struct Stats {
+        uint64_t lines;             // 写入文件的行数
+        uint64_t bytes;
+        uint64_t droppedLines;      // 因缓冲区满丢弃的行数
+        uint64_t droppedBytes;      // 丢弃的字节数(估算)：文本行按格式串长度计，延迟格式化的记录按编码后的长度计
+        uint64_t blocked;           // BLOCK策略下等待过的次数
+    };
+
+    // 初始化日志实例（异步时每个线程缓冲区大约容纳的行数(0为同步)、日志保存路径、日志文件后缀、
+    // 异步时是否把格式化推迟到写线程）
+    void init(int level, const char* path = "./log",
                 const char* suffix =".log",
-                int maxQueueCapacity = 1024);
+                int maxQueueCapacity = 1024,
+                bool deferred = true);
 
     static Log* Instance();
     static void FlushLogThread();   // 异步写日志公有方法，调用私有方法asyncWrite
-    
+
     void write(int level, const char *format,...);  // 将输出内容按照标准格式整理
+    // LOG_*宏不延迟格式化时的入口，std::string/string_view参数转换成const char*后再交给write
+    template<typename... Args>
+    void WriteArgs(int level, const char* format, const Args&... args);
+    // 登记调用点，返回编号，编号用完时返回-1(该调用点退回普通的write)
+    int RegisterSite(const LogSite* site);
+    // 只拷贝原始参数，由写线程按调用点的格式串格式化
+    template<typename... Args>
+    void WriteDeferred(int level, int site, const Args&... args);
+    bool IsDeferred() const { return deferred_; }
+    // 登记限速的调用点，异步模式下由写线程定期输出被丢弃的条数
+    void RegisterLimiter(LogLimiter* limiter);
+    // 同步模式下没有写线程，由调用点在放行时输出之前被丢弃的条数
+    void ReportSuppressed(LogLimiter* limiter);
+    // 异步模式下等待写线程把调用前写入的日志全部落盘
     void flush();
 
-    int GetLevel();
-    void SetLevel(int level);
-    bool IsOpen() { return isOpen_; }
-    
+    // 等级和开关是原子变量，每条日志检查时不加锁
+    int GetLevel() const { return level_.load(std::memory_order_relaxed); }
+    void SetLevel(int level) { level_.store(level, std::memory_order_relaxed); }
+    bool IsOpen() const { return isOpen_.load(std::memory_order_relaxed); }
+    // 因缓冲区满被丢弃的行数
+    uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    Stats GetStats() const;
+    // BLOCK时最多等blockMS毫秒，磁盘再慢请求线程也不会一直被卡住
+    void SetOverflow(OVERFLOW_POLICY policy, int blockMS = 10);
+
+    // 切换文件的条件：单个文件的字节数上限、时间周期(秒，从本地零点起对齐，最长一天)，以及切换下来的文件是否压缩
+    void SetRotate(size_t maxBytes, int periodSec = 86400, bool compress = true);
+    void SetFsync(FSYNC_POLICY policy, int intervalMS = 1000);
+    // 等待已经切换下来的文件压缩完，最多等timeoutMS毫秒，返回是否都压缩完了
+    bool WaitCompress(int timeoutMS);
+
 private:
     Log();          //采用单例模式
-    void AppendLogLevelTitle_(int level);
     virtual ~Log();
     void AsyncWrite_(); // 异步写日志方法
 
+    // 当前线程的缓冲区，第一次写日志时创建并登记
+    LogRing* LocalRing_();
+    // 格式化一行(时间、等级、内容、换行)到buf，返回长度，超长时截断
+    static size_t FormatLine_(char* buf, size_t size, int level, const char* format, va_list vaList);
+    // 时间和等级前缀，日期部分每个线程每秒只格式化一次
+    static size_t FormatPrefix_(char* buf, size_t size, int level, time_t sec, long usec);
+    // 把一条延迟格式化的记录还原成一行文本，返回长度
+    size_t FormatDeferred_(char* buf, size_t size, const char* rec, size_t len);
+    // 按printf格式串和编码后的参数生成文本，返回长度(不超过size-1)
+    static size_t FormatArgs_(char* buf, size_t size, const char* format, const char* args, size_t len);
+    // 缓冲区超过一半时提前叫醒写线程
+    void WakeWriter_(LogRing* ring);
+    // Reserve失败后按溢出策略再试一次，仍然失败返回nullptr
+    char* ReserveSlow_(LogRing* ring);
+    // 延迟格式化模式下要丢弃的记录仍然编码到线程自己的临时缓冲区(只是拷贝参数)，以便统计字节数
+    static char* DropBuf_();
+    void CountDropped_(size_t bytes) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        droppedBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    // 写线程腾出空间后叫醒BLOCK策略下等待的线程
+    void NotifySpace_();
+    // 限速调用点被丢弃条数的汇总行，返回长度
+    static size_t FormatSuppressed_(char* buf, size_t size, const LogLimiter* limiter, uint64_t count);
+    // 写线程定期把所有限速调用点的丢弃条数各写成一行，force时不管间隔
+    void EmitSuppressed_(bool force);
+    // 延迟记录的时间戳：x86上是TSC计数，其他平台是CLOCK_MONOTONIC纳秒，由写线程换算成墙上时间
+    static uint64_t Ticks_() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+    }
+    static int64_t RealNs_();
+    // 校准计数与墙上时间的对应关系，init时测一次频率，写线程每秒重新取一次基准
+    void Calibrate_(bool init);
+    int64_t TicksToNs_(uint64_t ticks) const;
+    // 取出所有缓冲区中的记录写入文件，返回取出的记录字节数
+    size_t Drain_();
+    // 写出fmtBuf_中攒好的一批(调用方持有fileMtx_)
+    void WriteBatch_();
+    // 时间周期结束，或再写incoming字节会超过大小上限时切换文件(以下都由调用方持有fileMtx_)
+    void RotateIfNeeded_(size_t incoming);
+    // 打开当前周期的第fileIdx_个文件，已压缩或已写满的编号跳过
+    void OpenFile_();
+    // 关闭当前文件，rotated为true时交给压缩线程
+    void CloseFile_(bool rotated);
+    // 按刷盘策略决定是否fdatasync
+    void SyncIfNeeded_();
+
+    void ZipThread_();
+    // 把文件压缩成.gz，成功后删除原文件
+    static bool Gzip_(const std::string& path);
+
 private:
     static const int LOG_PATH_LEN = 256;    // 日志文件最长文件名
     static const int LOG_NAME_LEN = 256;    // 日志最长名字
-    static const int MAX_LINES = 50000;     // 日志文件内的最长日志条数
+    static const int LINE_LEN = 2048;       // 单行最大长度，超出部分截断
+    static const int AVG_LINE = 128;        // 估算缓冲区大小时每行的平均长度
+    static const int MAX_SITES = 4096;      // 延迟格式化的调用点上限
+    static const int FMT_BUF = 256 * 1024;  // 写线程攒一批的缓冲区，写满就先写出
+    static const int SUPPRESS_REPORT_MS = 5000;    // 输出限速汇总行的间隔
+    static const int DEFERRED_HEAD = 16;    // 延迟记录头：[uint32 等级][uint32 调用点][uint64 时间戳计数]
+
+    // 每条日志都要读的开关和等级单独占一个缓存行，不和写线程频繁修改的成员放在一起
+    alignas(64) std::atomic<bool> isOpen_;
+    std::atomic<int> level_;    // 日志等级
+    bool isAsync_;      // 是否开启异步日志
+    bool deferred_;     // 是否延迟格式化(只在异步模式下)
 
-    const char* path_;          //路径名
+    alignas(64) const char* path_;  //路径名
     const char* suffix_;        //后缀名
 
-    int MAX_LINES_;             // 最大日志行数
+    size_t maxBytes_;           // 单个文件的字节数上限
+    int periodSec_;             // 按时间切换的周期
+    bool compress_;             // 切换下来的文件是否压缩
+    FSYNC_POLICY fsync_;
+    int fsyncMS_;
 
-    int lineCount_;             //日志行数记录
-    int toDay_;                 //按当天日期区分文件
+    char period_[64];           // 当前周期的文件名前缀(日期，周期小于一天时带时分)
+    time_t periodEnd_;          // 当前周期结束的时间
+    int fileIdx_;               // 当前周期的第几个文件
+    size_t fileBytes_;          // 当前文件已写的字节数
+    std::string fileName_;
+    bool dirty_;                // 有写入还没刷盘
+    int64_t lastSync_;          // 上次刷盘的时间(毫秒)
 
-    bool isOpen_;               
- 
-    Buffer buff_;       // 输出的内容，缓冲区
-    int level_;         // 日志等级
-    bool isAsync_;      // 是否开启异步日志
-
-    FILE* fp_;                                          //打开log的文件指针
-    std::unique_ptr<BlockQueue<std::string>> deque_;    //阻塞队列
+    int fd_;                                            //日志文件描述符
     std::unique_ptr<std::thread> writeThread_;          //写线程的指针
-    std::mutex mtx_;                                    //同步日志必需的互斥量
+    std::mutex fileMtx_;                                //保护文件描述符和切换文件，异步模式下只有写线程使用
+
+    size_t ringSize_;                                   // 新建线程缓冲区的字节数
+    std::vector<std::unique_ptr<LogRing>> rings_;       // 所有线程的缓冲区
+    std::mutex ringsMtx_;                               // 只在登记新线程和写线程遍历时使用
+    std::atomic<bool> stop_;
+    std::atomic<bool> sleeping_;                        // 写线程正在等待
+    std::atomic<bool> wakeup_;                          // 生产者要求提前唤醒写线程
+    std::atomic<uint64_t> flushReq_;                    // flush请求序号
+    std::atomic<uint64_t> flushDone_;                   // 写线程已完成的flush序号
+    std::mutex condMtx_;
+    std::condition_variable cond_;                      // 唤醒写线程
+    std::condition_variable flushCond_;                 // 通知flush完成
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> droppedBytes_;
+    std::atomic<uint64_t> lines_;                       // 写线程写出的行数和字节数
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> blocked_;
+    std::atomic<OVERFLOW_POLICY> overflow_;
+    std::atomic<int> blockMS_;
+    std::atomic<int> waiters_;                          // BLOCK策略下正在等待的线程数
+    std::mutex spaceMtx_;
+    std::condition_variable spaceCond_;
+
+    std::atomic<const LogSite*> sites_[MAX_SITES];      // 按编号登记的调用点
+    std::atomic<int> siteCount_;
+    std::unique_ptr<char[]> fmtBuf_;                    // 攒一批要写出的行，只由写线程使用
+    size_t fmtUsed_;
+    uint64_t baseTicks_;                                // 校准基准，init后只由写线程修改
+    int64_t baseNs_;
+    double nsPerTick_;
+
+    std::vector<LogLimiter*> limiters_;                 // 所有限速的调用点
+    std::mutex limitersMtx_;
+    int64_t lastReport_;                                // 上次输出汇总行的时间(毫秒)，只由写线程使用
+
+    std::unique_ptr<std::thread> zipThread_;            // 压缩线程，第一次切换文件时启动
+    std::deque<std::string> zipQueue_;
+    std::mutex zipMtx_;
+    std::condition_variable zipCond_;
+    bool zipStop_;
+    bool zipping_;                                      // 正在压缩队列取出的文件
 };
 
+// 强制内联：不内联时每条多出约50ns(参数经栈传递、字符串常量的strlen不能在编译期算出)
+template<typename... Args>
+inline __attribute__((always_inline)) void Log::WriteDeferred(int level, int site, const Args&... args) {
+    LogRing* ring = LocalRing_();
+    char* buf = ring->Reserve(LINE_LEN);
+    if(!buf) {
+        buf = ReserveSlow_(ring);
+    }
+    bool reserved = buf != nullptr;
+    if(!reserved) {
+        buf = DropBuf_();
+    }
+    uint32_t head[2] = { static_cast<uint32_t>(level), static_cast<uint32_t>(site) };
+    uint64_t ticks = Ticks_();
+    memcpy(buf, head, 8);
+    memcpy(buf + 8, &ticks, 8);
+    LogArgWriter w(buf + DEFERRED_HEAD, buf + LINE_LEN);
+    (w.Put(args), ...);
+    if(reserved) {
+        ring->Commit(LogRing::DEFERRED, w.End() - buf);
+        WakeWriter_(ring);
+    } else {
+        CountDropped_(w.End() - buf);
+    }
+}
+
+template<typename... Args>
+inline void Log::WriteArgs(int level, const char* format, const Args&... args) {
+    write(level, format, LogVaArg::Pass(LogVaArg::Own(args))...);
+}
+
+// 编译期的最低等级，低于它的LOG_*在编译时整个去掉(参数也不求值)，如-DLOG_MIN_LEVEL=1去掉所有DEBUG
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// 延迟格式化时每个调用点用静态变量登记一次，之后只拷贝参数
+#define LOG_EMIT_(log, level, format, ...) \
+    do {\
+        static const LogSite logSite_ = { format, __FILE__, __LINE__ };\
+        static const int logSiteId_ = log->RegisterSite(&logSite_);\
+        if (log->IsDeferred() && logSiteId_ >= 0) {\
+            log->WriteDeferred(level, logSiteId_, ##__VA_ARGS__); \
+        } else {\
+            log->WriteArgs(level, format, ##__VA_ARGS__); \
+        }\
+    } while(0)
+
 #define LOG_BASE(level, format, ...) \
     do {\
+        if ((level) < LOG_MIN_LEVEL) { break; }\
         Log* log = Log::Instance();\
-        if (log->IsOpen() && log->GetLevel() <= level) {\
-            log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
+        if (log->IsOpen() && log->GetLevel() <= (level)) {\
+            LOG_EMIT_(log, level, format, ##__VA_ARGS__);\
         }\
     } while(0);
 
+// 带限速/抽样的LOG_BASE，每个调用点一个静态的LogLimiter
+#define LOG_LIMITED_(level, perSec, burst, sampleN, format, ...) \
+    do {\
+        if ((level) < LOG_MIN_LEVEL) { break; }\
+        Log* log = Log::Instance();\
+        if (log->IsOpen() && log->GetLevel() <= (level)) {\
+            static LogLimiter logLimiter_(__FILE__, __LINE__, level, perSec, burst, sampleN);\
+            static const bool logLimiterReg_ = (log->RegisterLimiter(&logLimiter_), true);\
+            (void)logLimiterReg_;\
+            if (logLimiter_.Allow()) {\
+                log->ReportSuppressed(&logLimiter_);\
+                LOG_EMIT_(log, level, format, ##__VA_ARGS__);\
+            }\
+        }\
+    } while(0);
+
+// 每秒最多perSec条(允许一秒的突发)，多出的丢弃并定期汇总，适合连接建立、断开这类随流量增长的日志
+#define LOG_RATE(level, perSec, format, ...) LOG_LIMITED_(level, perSec, perSec, 1, format, ##__VA_ARGS__)
+// 每n条只记1条
+#define LOG_SAMPLE(level, n, format, ...) LOG_LIMITED_(level, 0, 0, n, format, ##__VA_ARGS__)
+
 // 四个宏定义，主要用于不同类型的日志输出，也是外部使用日志的接口
 // ...表示可变参数，__VA_ARGS__就是将...的值复制到这里
 // 前面加上##的作用是：当可变参数的个数为0时，这里的##可以把把前面多余的","去掉,否则会编译出错。
-#define LOG_DEBUG(format, ...) do {LOG_BASE(0, format, ##__VA_ARGS__)} while(0);    
+#define LOG_DEBUG(format, ...) do {LOG_BASE(0, format, ##__VA_ARGS__)} while(0);
 #define LOG_INFO(format, ...) do {LOG_BASE(1, format, ##__VA_ARGS__)} while(0);
 #define LOG_WARN(format, ...) do {LOG_BASE(2, format, ##__VA_ARGS__)} while(0);
 #define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
@@ -0,0 +1,103 @@
+#ifndef LOG_ARG_H
+#define LOG_ARG_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/*
+延迟格式化日志的参数编码
+调用点只记录格式串的编号和原始参数，由写线程按格式串还原成文本，请求线程上不再调用vsnprintf
+每个参数：[uint8 类型][内容]，整数、浮点、指针固定8字节，字符串为[uint32 长度][字节]
+*/
+
+// 一个日志调用点，第一次执行时登记，之后只记录编号
+struct LogSite {
+    const char* format;     // 必须是字符串常量
+    const char* file;
+    int line;
+};
+
+class LogArgWriter {
+public:
+    enum Type : uint8_t { INT = 0, UINT, DOUBLE, STR, PTR };
+
+    LogArgWriter(char* begin, char* end): p_(begin), end_(end), full_(false) {}
+
+    // 按参数的静态类型编码，空间不够时丢弃这个及之后的参数，格式化时显示为空
+    template<typename T>
+    void Put(const T& v) {
+        typedef typename std::decay<T>::type D;
+        constexpr bool isStr = std::is_same<D, char*>::value || std::is_same<D, const char*>::value;
+        if constexpr(isStr && std::is_array<T>::value) {
+            PutStr_(v, strlen(v));      // 字符数组和字符串常量
+        } else if constexpr(isStr) {
+            if(v) { PutStr_(v, strlen(v)); } else { PutStr_("(null)", 6); }
+        } else if constexpr(std::is_same<D, std::string>::value || std::is_same<D, std::string_view>::value) {
+            PutStr_(v.data(), v.size());
+        } else if constexpr(std::is_floating_point<D>::value) {
+            double x = v;
+            Put8_(DOUBLE, &x);
+        } else if constexpr(std::is_pointer<D>::value) {
+            uint64_t x = reinterpret_cast<uintptr_t>(v);
+            Put8_(PTR, &x);
+        } else if constexpr(std::is_enum<D>::value) {
+            int64_t x = static_cast<int64_t>(v);
+            Put8_(INT, &x);
+        } else {
+            static_assert(std::is_integral<D>::value, "unsupported log argument type");
+            if constexpr(std::is_signed<D>::value) {
+                int64_t x = v;
+                Put8_(INT, &x);
+            } else {
+                uint64_t x = v;
+                Put8_(UINT, &x);
+            }
+        }
+    }
+
+    char* End() const { return p_; }
+
+private:
+    void Put8_(Type type, const void* v) {
+        if(full_ || end_ - p_ < 9) { full_ = true; return; }
+        *p_ = static_cast<char>(type);
+        memcpy(p_ + 1, v, 8);
+        p_ += 9;
+    }
+
+    // 太长的字符串截断到剩余空间
+    void PutStr_(const char* s, size_t len) {
+        if(full_ || end_ - p_ < 5) { full_ = true; return; }
+        size_t room = static_cast<size_t>(end_ - p_) - 5;
+        uint32_t n = static_cast<uint32_t>(len < room ? len : room);
+        *p_ = static_cast<char>(STR);
+        memcpy(p_ + 1, &n, 4);
+        memcpy(p_ + 5, s, n);
+        p_ += 5 + n;
+    }
+
+    char* p_;
+    char* end_;
+    bool full_;
+};
+
+// 不延迟格式化时参数经C可变参数交给vsnprintf，std::string/string_view不能这样传递，先换成const char*
+struct LogVaArg {
+    // string_view不一定以'\0'结尾，拷贝成临时的std::string，活到write返回
+    static std::string Own(std::string_view v) { return std::string(v); }
+    template<typename T>
+    static const T& Own(const T& v) { return v; }
+
+    static const char* Pass(const std::string& v) { return v.c_str(); }
+    template<typename T>
+    static typename std::decay<const T>::type Pass(const T& v) {
+        static_assert(std::is_trivially_copyable<typename std::decay<const T>::type>::value,
+                      "log argument cannot be passed through C varargs");
+        return v;
+    }
+};
+
+#endif //LOG_ARG_H
@@ -0,0 +1,71 @@
+#ifndef LOG_LIMITER_H
+#define LOG_LIMITER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+/*
+单个日志调用点的限速和抽样，由LOG_RATE/LOG_SAMPLE宏以静态变量的形式创建
+限速用令牌桶(GCRA写法)：只用一个原子变量记录"理论到达时间"，每条日志推后1/perSec秒，
+超前当前时间超过burst条的额度时丢弃；抽样为每sampleN条取1条
+被丢弃的条数累计起来，由日志定期输出一行"suppressed N similar messages"
+*/
+class LogLimiter {
+public:
+    // perSec为0时不限速，sampleN为1时不抽样
+    LogLimiter(const char* file, int line, int level, double perSec, int burst, int sampleN)
+        : file_(file), line_(line), level_(level), sampleN_(sampleN > 1 ? sampleN : 1),
+          intervalNs_(perSec > 0 ? static_cast<int64_t>(1e9 / perSec) : 0),
+          toleranceNs_(perSec > 0 ? static_cast<int64_t>(1e9 / perSec) * (burst > 1 ? burst - 1 : 0) : 0),
+          tat_(0), count_(0), suppressed_(0) {}
+
+    bool Allow() {
+        if(sampleN_ > 1 && count_.fetch_add(1, std::memory_order_relaxed) % sampleN_ != 0) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if(intervalNs_ == 0) {
+            return true;
+        }
+        int64_t now = NowNs_();
+        int64_t tat = tat_.load(std::memory_order_relaxed);
+        while(true) {
+            int64_t next = (tat > now ? tat : now) + intervalNs_;
+            if(next - now > toleranceNs_ + intervalNs_) {
+                suppressed_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if(tat_.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    // 取出并清零被丢弃的条数
+    uint64_t TakeSuppressed() { return suppressed_.exchange(0, std::memory_order_relaxed); }
+    uint64_t Suppressed() const { return suppressed_.load(std::memory_order_relaxed); }
+    const char* File() const { return file_; }
+    int Line() const { return line_; }
+    int Level() const { return level_; }
+
+private:
+    // 粗粒度时钟(几毫秒精度)足够限速用，比CLOCK_MONOTONIC便宜
+    static int64_t NowNs_() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    const char* file_;
+    int line_;
+    int level_;
+    const uint64_t sampleN_;
+    const int64_t intervalNs_;      // 每条日志占用的时间
+    const int64_t toleranceNs_;     // 允许的突发量
+    std::atomic<int64_t> tat_;      // 理论到达时间
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> suppressed_;
+};
+
+#endif //LOG_LIMITER_H
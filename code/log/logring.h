@@ -0,0 +1,145 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <atomic>
+#include <memory>
+#include <string.h>
+#include <stdint.h>
+
+/*
+单生产者单消费者的字节环形缓冲区，每个写日志的线程独占一个，由日志写线程消费
+记录按8字节对齐：[uint32 长度][uint32 标签][内容]，放不下时在末尾补一个PAD记录后绕回开头，
+所以每条记录的内容总是连续的，生产者可以直接格式化到缓冲区里
+缓冲区的字节只有生产者写；head只有生产者写，tail由消费者逐条推进，没有锁
+缓冲区满时Reserve返回nullptr，由调用方按溢出策略决定：丢弃新记录，或用DropOldest从tail丢弃最早的记录，
+这时生产者和消费者都会CAS推进tail，消费者先把记录拷走再Pop确认，Pop失败说明这条已被丢弃，拷出的内容作废
+*/
+class LogRing {
+public:
+    enum Tag : uint32_t {
+        TEXT = 0,       // 格式化好的一行文本
+        PAD = 1,        // 末尾放不下时的填充
+        DEFERRED = 2,   // 二进制记录(格式串编号+原始参数)，由写线程格式化，2及以上都是二进制记录
+        ACCESS = 3,     // 访问日志的定长记录(AccessRecord)
+    };
+
+    static const size_t HEADER = 8;
+
+    // 容量向上取到2的幂
+    explicit LogRing(size_t capacity): head_(0), cachedTail_(0), reserved_(0), tail_(0), detached_(false) {
+        cap_ = 4096;
+        while(cap_ < capacity) { cap_ <<= 1; }
+        mask_ = cap_ - 1;
+        buf_.reset(new char[cap_]);
+    }
+
+    /* ---------- 生产者 ---------- */
+
+    // 预留len字节的连续空间，返回内容的起始地址，空间不够时返回nullptr
+    char* Reserve(size_t len) {
+        size_t need = Align_(HEADER + len);
+        if(need > cap_ / 2) { return nullptr; }
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t pos = head & mask_;
+        size_t pad = (cap_ - pos < need) ? cap_ - pos : 0;
+        if(head + pad + need - cachedTail_ > cap_) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if(head + pad + need - cachedTail_ > cap_) { return nullptr; }
+        }
+        if(pad) {
+            WriteHeader_(pos, static_cast<uint32_t>(pad - HEADER), PAD);
+        }
+        reserved_ = head + pad;
+        return buf_.get() + (reserved_ & mask_) + HEADER;
+    }
+
+    // 提交最近一次Reserve的记录，len不能超过预留的长度
+    void Commit(uint32_t tag, size_t len) {
+        WriteHeader_(reserved_ & mask_, static_cast<uint32_t>(len), tag);
+        head_.store(reserved_ + Align_(HEADER + len), std::memory_order_release);
+    }
+
+    // 已用字节数(生产者和消费者都可以调用，结果是近似值)
+    size_t Used() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    size_t Capacity() const { return cap_; }
+    // 生产者看到的已用字节数，只读缓存的tail，偏大但不访问消费者的缓存行
+    size_t ProducerUsed() const { return head_.load(std::memory_order_relaxed) - cachedTail_; }
+
+    // 线程退出时调用，之后由消费者取完剩余记录后释放
+    void Detach() { detached_.store(true, std::memory_order_release); }
+    bool Detached() const { return detached_.load(std::memory_order_acquire); }
+
+    // 丢弃最早的记录，直到能放下len字节的新记录，返回丢弃的内容字节数，lines累加丢弃的条数
+    size_t DropOldest(size_t len, uint64_t& lines) {
+        size_t need = Align_(HEADER + len);
+        if(need > cap_ / 2) { return 0; }
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t pos = head & mask_;
+        size_t pad = (cap_ - pos < need) ? cap_ - pos : 0;
+        size_t bytes = 0;
+        size_t tail = tail_.load(std::memory_order_acquire);
+        while(head + pad + need - tail > cap_) {
+            // tail处的记录是自己写的，读它的头是安全的
+            uint32_t recLen, tag;
+            memcpy(&recLen, buf_.get() + (tail & mask_), 4);
+            memcpy(&tag, buf_.get() + (tail & mask_) + 4, 4);
+            if(tail_.compare_exchange_weak(tail, tail + Align_(HEADER + recLen), std::memory_order_acq_rel)) {
+                if(tag != PAD) {
+                    bytes += recLen;
+                    lines++;
+                }
+                tail += Align_(HEADER + recLen);
+            }
+            // 失败时tail已被更新为消费者推进后的值
+        }
+        cachedTail_ = tail;
+        return bytes;
+    }
+
+    /* ---------- 消费者 ---------- */
+
+    // 取最早的一条记录(包括PAD)，没有时返回false
+    // 记录可能同时被生产者丢弃并覆盖，使用前先拷走，再用Pop确认
+    bool Front(size_t& pos, uint32_t& tag, const char*& data, uint32_t& len) const {
+        while(true) {
+            size_t tail = tail_.load(std::memory_order_acquire);
+            if(tail == head_.load(std::memory_order_acquire)) { return false; }
+            const char* p = buf_.get() + (tail & mask_);
+            memcpy(&len, p, 4);
+            memcpy(&tag, p + 4, 4);
+            if((tail & mask_) + Align_(HEADER + len) > cap_) {
+                continue;   // 只会是读到了正在被覆盖的头，tail已经变了
+            }
+            pos = tail;
+            data = p + HEADER;
+            return true;
+        }
+    }
+
+    // 确认取走Front返回的记录，返回false表示这条已被生产者丢弃
+    bool Pop(size_t pos, uint32_t len) {
+        return tail_.compare_exchange_strong(pos, pos + Align_(HEADER + len), std::memory_order_acq_rel);
+    }
+
+private:
+    static size_t Align_(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+
+    void WriteHeader_(size_t pos, uint32_t len, uint32_t tag) {
+        memcpy(buf_.get() + pos, &len, 4);
+        memcpy(buf_.get() + pos + 4, &tag, 4);
+    }
+
+    // 生产者写的下标和缓存，与消费者的下标分开在不同的缓存行
+    alignas(64) std::atomic<size_t> head_;
+    size_t cachedTail_;         // 生产者看到的tail，不够用时才重新读取
+    size_t reserved_;           // 预留记录的起始位置
+    alignas(64) std::atomic<size_t> tail_;
+    std::atomic<bool> detached_;
+    alignas(64) std::unique_ptr<char[]> buf_;
+    size_t cap_;
+    size_t mask_;
+};
+
+#endif //LOG_RING_H
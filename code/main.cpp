@@ -6,7 +6,9 @@ int main() {
     WebServer server(
         1316, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
         3306, "debian-sys-maint", "XRwsTo3FP0IjrmDf", "yourdb", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 6, true, 1, 1024,              /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        1, false, 64,                      /* 反应堆数量(大于1时为每线程一个事件循环的多反应堆模式) 是否使用io_uring 静态文件缓存(MB，0为关闭) */
+        1);                                /* 访问日志每几个请求记一个(0为关闭，4xx、5xx总是记录) */
     server.Start();
 } 
 
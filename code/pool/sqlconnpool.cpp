@@ -1,4 +1,6 @@
 #include "sqlconnpool.h"
+
+using namespace std;
 //创建静态单例对象
 SqlConnPool* SqlConnPool::Instance() {
     static SqlConnPool pool;
@@ -28,6 +30,19 @@ void SqlConnPool::Init(const char* host, int port,
         }
         // 将连接放入队列
         connQue_.emplace(conn);
+        if(!conn) {
+            continue;   // 连接失败时不建语句表，GetStmt对它返回nullptr
+        }
+        stmts_[conn];
+        // 启动前登记过的语句在这里就准备好，之后登记的第一次用到时再准备
+        size_t stmtCount;
+        {
+            lock_guard<mutex> locker(stmtMtx_);
+            stmtCount = stmtSql_.size();
+        }
+        for(size_t id = 0; id < stmtCount; id++) {
+            GetStmt(conn, static_cast<int>(id));
+        }
     }
     // 设置最大连接数
     MAX_CONN_ = connSize;
@@ -66,6 +81,8 @@ void SqlConnPool::ClosePool() {
         auto conn = connQue_.front();
         // 弹出连接队列的第一个连接
         connQue_.pop();
+        // 语句要在连接关闭前释放
+        stmts_.erase(conn);
         // 关闭连接
         mysql_close(conn);
     }
@@ -79,3 +96,37 @@ int SqlConnPool::GetFreeConnCount() {
     // 返回连接队列中空闲连接的数量
     return connQue_.size();
 }
+
+int SqlConnPool::RegisterStmt(const char* sql) {
+    lock_guard<mutex> locker(stmtMtx_);
+    stmtSql_.push_back(sql);
+    return static_cast<int>(stmtSql_.size()) - 1;
+}
+
+SqlStmt* SqlConnPool::GetStmt(MYSQL* conn, int id) {
+    auto it = stmts_.find(conn);
+    if(it == stmts_.end() || id < 0) {
+        return nullptr;
+    }
+    vector<unique_ptr<SqlStmt>>& stmts = it->second;
+    if(static_cast<size_t>(id) < stmts.size() && stmts[id]) {
+        return stmts[id].get();
+    }
+    const char* sql;
+    {
+        lock_guard<mutex> locker(stmtMtx_);
+        if(static_cast<size_t>(id) >= stmtSql_.size()) {
+            return nullptr;
+        }
+        sql = stmtSql_[id];
+    }
+    unique_ptr<SqlStmt> stmt(new SqlStmt(conn, sql));
+    if(!stmt->Ok()) {
+        return nullptr;     // 下次再试
+    }
+    if(stmts.size() <= static_cast<size_t>(id)) {
+        stmts.resize(id + 1);
+    }
+    stmts[id] = move(stmt);
+    return stmts[id].get();
+}
@@ -5,9 +5,13 @@
 #include <string>
 #include <queue>
 #include <mutex>
+#include <vector>
+#include <memory>
+#include <unordered_map>
 #include <semaphore.h>
 #include <thread>
 #include "../log/log.h"
+#include "sqlstmt.h"
 
 class SqlConnPool {
 public:
@@ -19,6 +23,11 @@ public:
     void FreeConn(MYSQL * conn);
     // 获取当前空闲连接数
     int GetFreeConnCount();
+    // 登记一条在每个连接上预编译的语句，返回编号
+    int RegisterStmt(const char* sql);
+    // 连接conn上编号为id的语句，每个连接第一次用到时准备，之后复用，准备失败返回nullptr
+    // 调用方必须持有该连接
+    SqlStmt* GetStmt(MYSQL* conn, int id);
 
     // 初始化连接池
     void Init(const char* host, int port,
@@ -42,6 +51,12 @@ private:
     std::mutex mtx_;
     // 信号量
     sem_t semId_;
+
+    // 登记的语句，只增不减
+    std::vector<const char*> stmtSql_;
+    std::mutex stmtMtx_;
+    // 每个连接上已准备的语句，按编号存放；键在Init后不变，值只由持有连接的线程访问，不加锁
+    std::unordered_map<MYSQL*, std::vector<std::unique_ptr<SqlStmt>>> stmts_;
 };
 
 /* 资源在对象构造初始化 资源在对象析构时释放*/
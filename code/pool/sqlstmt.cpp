@@ -0,0 +1,122 @@
+#include "sqlstmt.h"
+#include <string.h>
+#include "../log/log.h"
+
+using namespace std;
+
+SqlStmt::SqlStmt(MYSQL* conn, const char* sql)
+    : stmt_(nullptr), paramCount_(0), columnCount_(0), hasResult_(false) {
+    MYSQL_STMT* stmt = conn ? mysql_stmt_init(conn) : nullptr;
+    if(!stmt) {
+        LOG_ERROR("MySql stmt init error!");
+        return;
+    }
+    if(mysql_stmt_prepare(stmt, sql, strlen(sql))) {
+        LOG_ERROR("MySql prepare error: %s", mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return;
+    }
+    stmt_ = stmt;
+    paramCount_ = mysql_stmt_param_count(stmt_);
+    params_.assign(paramCount_, MYSQL_BIND());     // 值初始化即全部清零
+    paramLen_.resize(paramCount_);
+
+    // 结果列的缓冲区只分配一次，每次执行后重新绑定
+    MYSQL_RES* meta = mysql_stmt_result_metadata(stmt_);
+    if(meta) {
+        columnCount_ = mysql_num_fields(meta);
+        mysql_free_result(meta);
+    }
+    columns_.assign(columnCount_, MYSQL_BIND());
+    columnBuf_.assign(columnCount_, string(COLUMN_BUF, '\0'));
+    columnLen_.resize(columnCount_);
+    columnNull_.reset(new NullFlag[columnCount_ + 1]());
+    for(unsigned int i = 0; i < columnCount_; i++) {
+        columns_[i].buffer_type = MYSQL_TYPE_STRING;
+        columns_[i].buffer = &columnBuf_[i][0];
+        columns_[i].buffer_length = COLUMN_BUF;
+        columns_[i].length = &columnLen_[i];
+        columns_[i].is_null = &columnNull_[i];
+    }
+}
+
+SqlStmt::~SqlStmt() {
+    if(stmt_) {
+        if(hasResult_) { mysql_stmt_free_result(stmt_); }
+        mysql_stmt_close(stmt_);
+    }
+}
+
+bool SqlStmt::Execute(initializer_list<string_view> params) {
+    if(!stmt_ || params.size() != paramCount_) {
+        return false;
+    }
+    if(hasResult_) {    // 上次的结果没有读完
+        mysql_stmt_free_result(stmt_);
+        hasResult_ = false;
+    }
+    size_t i = 0;
+    for(string_view param: params) {
+        MYSQL_BIND& bind = params_[i];
+        paramLen_[i] = param.size();
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer = const_cast<char*>(param.data());
+        bind.buffer_length = param.size();
+        bind.length = &paramLen_[i];
+        i++;
+    }
+    if(paramCount_ > 0 && mysql_stmt_bind_param(stmt_, params_.data())) {
+        LOG_ERROR("MySql bind error: %s", mysql_stmt_error(stmt_));
+        return false;
+    }
+    if(mysql_stmt_execute(stmt_)) {
+        LOG_ERROR("MySql execute error: %s", mysql_stmt_error(stmt_));
+        return false;
+    }
+    if(columnCount_ > 0) {
+        if(mysql_stmt_bind_result(stmt_, columns_.data()) || mysql_stmt_store_result(stmt_)) {
+            LOG_ERROR("MySql result error: %s", mysql_stmt_error(stmt_));
+            return false;
+        }
+        hasResult_ = true;
+    }
+    return true;
+}
+
+bool SqlStmt::Fetch(vector<string>& row) {
+    if(!hasResult_) {
+        return false;
+    }
+    int ret = mysql_stmt_fetch(stmt_);
+    if(ret != 0 && ret != MYSQL_DATA_TRUNCATED) {   // MYSQL_NO_DATA或出错，结果集读完
+        mysql_stmt_free_result(stmt_);
+        hasResult_ = false;
+        return false;
+    }
+    row.resize(columnCount_);
+    for(unsigned int i = 0; i < columnCount_; i++) {
+        if(columnNull_[i]) {
+            row[i].clear();
+        } else if(columnLen_[i] <= COLUMN_BUF) {
+            row[i].assign(columnBuf_[i].data(), columnLen_[i]);
+        } else {
+            // 超出缓冲区的列按实际长度单独再取一次
+            row[i].resize(columnLen_[i]);
+            MYSQL_BIND bind;
+            memset(&bind, 0, sizeof(bind));
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = &row[i][0];
+            bind.buffer_length = columnLen_[i];
+            mysql_stmt_fetch_column(stmt_, &bind, i, 0);
+        }
+    }
+    return true;
+}
+
+uint64_t SqlStmt::AffectedRows() {
+    return stmt_ ? mysql_stmt_affected_rows(stmt_) : 0;
+}
+
+const char* SqlStmt::Error() {
+    return stmt_ ? mysql_stmt_error(stmt_) : "statement not prepared";
+}
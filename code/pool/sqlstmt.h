@@ -0,0 +1,52 @@
+#ifndef SQLSTMT_H
+#define SQLSTMT_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <initializer_list>
+#include <type_traits>
+
+/*
+预编译语句：SQL只在准备时解析一次，之后每次执行只传二进制参数，参数不会拼进SQL文本，也就没有注入的问题
+参数和结果列都按字符串绑定，够登录、注册这类查询用
+一个语句属于一个连接，由持有该连接的线程独占使用，不加锁
+*/
+class SqlStmt {
+public:
+    SqlStmt(MYSQL* conn, const char* sql);
+    ~SqlStmt();
+    SqlStmt(const SqlStmt&) = delete;
+    SqlStmt& operator=(const SqlStmt&) = delete;
+
+    // 准备是否成功
+    bool Ok() const { return stmt_ != nullptr; }
+    // 绑定参数并执行，有结果集时取回客户端，之后用Fetch逐行读取
+    bool Execute(std::initializer_list<std::string_view> params);
+    // 取下一行，没有了返回false，NULL列为空串
+    bool Fetch(std::vector<std::string>& row);
+    // INSERT/UPDATE影响的行数
+    uint64_t AffectedRows();
+    const char* Error();
+
+private:
+    // MySQL 8.0的is_null是bool*，更早的版本是my_bool*，按头文件里的实际类型声明
+    typedef std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type NullFlag;
+
+    static const size_t COLUMN_BUF = 256;   // 每列的初始缓冲区，更长的值在Fetch时单独取
+
+    MYSQL_STMT* stmt_;
+    unsigned int paramCount_;
+    unsigned int columnCount_;
+    bool hasResult_;                        // 上次执行的结果集还没释放
+    std::vector<MYSQL_BIND> params_;
+    std::vector<unsigned long> paramLen_;
+    std::vector<MYSQL_BIND> columns_;
+    std::vector<std::string> columnBuf_;
+    std::vector<unsigned long> columnLen_;
+    std::unique_ptr<NullFlag[]> columnNull_;   // 不用vector，vector<bool>取不到元素的地址
+};
+
+#endif // SQLSTMT_H
@@ -0,0 +1,128 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+
+/*
+线程池的任务类型，替代std::function<void()>
+可调用对象不超过CAPACITY字节且可平凡复制(如只捕获指针的lambda)时直接存放在内部缓冲区，
+构造、移动、执行都不分配内存；其他可调用对象退化为堆上存放
+Task只能移动，持有可调用对象，执行后或者没执行就被析构、覆盖时释放，每个Task只能执行一次
+工作窃取队列要求元素可平凡复制，用Release/Task(Raw)在Task和不管理生命周期的Raw之间转交所有权
+*/
+class Task {
+public:
+    static const size_t CAPACITY = 48;
+
+    // 可平凡复制的原始表示，不负责释放可调用对象
+    struct Raw {
+        void (*invoke)(void*);
+        void (*destroy)(void*);     // 内联存放的可调用对象不需要释放，为nullptr
+        alignas(std::max_align_t) unsigned char storage[CAPACITY];
+    };
+
+    Task() { raw_.invoke = nullptr; raw_.destroy = nullptr; }
+
+    template<typename F,
+             typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value
+                                                && !std::is_same<typename std::decay<F>::type, Raw>::value>::type>
+    Task(F&& f) {
+        typedef typename std::decay<F>::type Fn;
+        Init_<Fn>(std::forward<F>(f), std::integral_constant<bool, IsInline<Fn>()>());
+    }
+
+    // 接管Release交出的可调用对象
+    explicit Task(const Raw& raw) : raw_(raw) {}
+
+    Task(Task&& other) noexcept : raw_(other.raw_) {
+        other.raw_.invoke = nullptr;
+        other.raw_.destroy = nullptr;
+    }
+
+    // 先释放原来没执行的可调用对象
+    Task& operator=(Task&& other) noexcept {
+        if(this != &other) {
+            Reset_();
+            raw_ = other.raw_;
+            other.raw_.invoke = nullptr;
+            other.raw_.destroy = nullptr;
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { Reset_(); }
+
+    // 执行任务，之后释放可调用对象，执行时抛出异常也会释放
+    void operator()() {
+        assert(raw_.invoke);
+        Task task(std::move(*this));
+        task.raw_.invoke(task.raw_.storage);
+    }
+
+    explicit operator bool() const { return raw_.invoke != nullptr; }
+
+    // 交出可调用对象的所有权，之后由接管的Task负责释放
+    Raw Release() {
+        Raw raw = raw_;
+        raw_.invoke = nullptr;
+        raw_.destroy = nullptr;
+        return raw;
+    }
+
+    // 可调用对象能否不分配内存地存放
+    template<typename Fn>
+    static constexpr bool IsInline() {
+        return sizeof(Fn) <= CAPACITY && alignof(Fn) <= alignof(std::max_align_t)
+            && std::is_trivially_copyable<Fn>::value;
+    }
+
+private:
+    template<typename Fn, typename F>
+    void Init_(F&& f, std::true_type) {
+        new (raw_.storage) Fn(std::forward<F>(f));
+        raw_.invoke = &InvokeInline_<Fn>;
+        raw_.destroy = nullptr;
+    }
+
+    template<typename Fn, typename F>
+    void Init_(F&& f, std::false_type) {
+        Fn* p = new Fn(std::forward<F>(f));
+        new (raw_.storage) Fn*(p);
+        raw_.invoke = &InvokeHeap_<Fn>;
+        raw_.destroy = &DestroyHeap_<Fn>;
+    }
+
+    void Reset_() {
+        if(raw_.destroy) {
+            raw_.destroy(raw_.storage);
+        }
+        raw_.invoke = nullptr;
+        raw_.destroy = nullptr;
+    }
+
+    template<typename Fn>
+    static void InvokeInline_(void* p) {
+        (*static_cast<Fn*>(p))();
+    }
+
+    template<typename Fn>
+    static void InvokeHeap_(void* p) {
+        (**static_cast<Fn**>(p))();
+    }
+
+    template<typename Fn>
+    static void DestroyHeap_(void* p) {
+        delete *static_cast<Fn**>(p);
+    }
+
+    Raw raw_;
+};
+
+#endif //TASK_H
@@ -1,64 +1,176 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <queue>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
-#include <functional>
 #include <thread>
+#include <atomic>
 #include <assert.h>
+#include "workqueue.h"
+#include "task.h"
 
-
+/*
+工作窃取线程池
+外部线程(事件循环)提交的任务进入无锁的全局注入队列，工作线程内部再提交的任务进入自己的本地队列；
+工作线程按 本地队列 -> 全局队列 -> 窃取其他线程 的顺序取任务，
+取不到时先自旋一段时间，仍然没有才在条件变量上休眠，只有存在休眠线程时提交方才需要加锁唤醒
+任务以Task按值存放，小的可调用对象(如只捕获几个指针的lambda)提交和执行都不分配内存
+*/
 class ThreadPool {
 public:
     ThreadPool() = default;
     ThreadPool(ThreadPool&&) = default;
     // 尽量用make_shared代替new，如果通过new再传递给shared_ptr，内存是不连续的，会造成内存碎片化
-    explicit ThreadPool(int threadCount = 8) : pool_(std::make_shared<Pool>()) { // make_shared:传递右值，功能是在动态内存中分配一个对象并初始化它，返回指向此对象的shared_ptr
+    explicit ThreadPool(int threadCount = 8) : pool_(std::make_shared<Pool>(threadCount)) {
         assert(threadCount > 0);
         for(int i = 0; i < threadCount; i++) {
-            std::thread([this]() {
-                std::unique_lock<std::mutex> locker(pool_->mtx_);
-                while(true) {
-                    if(!pool_->tasks.empty()) { // 如果任务队列不为空
-                        auto task = std::move(pool_->tasks.front());    // 取出任务队列中的第一个任务
-                        pool_->tasks.pop();                            // 弹出任务队列中的第一个任务
-                        locker.unlock();                                // 解锁
-                        task();                                         // 执行任务
-                        locker.lock();                                  // 上锁
-                    } else if(pool_->isClosed) {                       // 如果线程池已关闭
-                        break;                                         // 退出循环
-                    } else {
-                        pool_->cond_.wait(locker);    // 如果任务队列为空，等待
-                    }
-                    
-                }
-            }).detach();
+            // 线程持有pool的shared_ptr，线程池对象析构后剩余任务仍能安全执行完
+            std::shared_ptr<Pool> pool = pool_;
+            std::thread([pool, i]() { pool->Run(i); }).detach();
         }
     }
 
     ~ThreadPool() {
         if(pool_) {
-            std::unique_lock<std::mutex> locker(pool_->mtx_);
-            pool_->isClosed = true;
+            pool_->Close();
         }
-        pool_->cond_.notify_all();  // 唤醒所有的线程
     }
 
     template<typename T>
     void AddTask(T&& task) {
-        std::unique_lock<std::mutex> locker(pool_->mtx_);
-        pool_->tasks.emplace(std::forward<T>(task));
-        pool_->cond_.notify_one();
+        pool_->Push(Task(std::forward<T>(task)));
     }
 
 private:
     // 用一个结构体封装起来，方便调用
     struct Pool {
-        std::mutex mtx_;                //互斥锁
-        std::condition_variable cond_;  //条件变量
-        bool isClosed;                  
-        std::queue<std::function<void()>> tasks; // 任务队列，函数类型为void()
+        static const int SPIN_COUNT = 64;       // 休眠前的自旋次数
+        static const size_t GLOBAL_CAP = 16384; // 全局队列容量
+        static const size_t LOCAL_CAP = 1024;   // 本地队列容量
+
+        explicit Pool(int n) : global(GLOBAL_CAP), sleepers(0), isClosed(false) {
+            for(int i = 0; i < n; i++) {
+                locals.emplace_back(new WorkStealingDeque<Task::Raw>(LOCAL_CAP));
+            }
+        }
+
+        // 当前线程所属的池和在池中的下标(头文件内用函数局部静态变量，避免多重定义)
+        static Pool*& Current() {
+            static thread_local Pool* pool = nullptr;
+            return pool;
+        }
+        static int& CurrentIndex() {
+            static thread_local int index = -1;
+            return index;
+        }
+
+        // 当前线程若是本池的工作线程，返回其下标，否则返回-1
+        int WorkerIndex() const {
+            return (Current() == this) ? CurrentIndex() : -1;
+        }
+
+        void Push(Task&& task) {
+            int idx = WorkerIndex();
+            bool pushed = false;
+            if(idx >= 0) {
+                // 工作线程内部提交，放进本地队列，其他线程可以来窃取；放进去以后由取出方接管
+                Task::Raw raw = task.Release();
+                pushed = locals[idx]->Push(raw);
+                if(!pushed) {
+                    task = Task(raw);
+                }
+            }
+            if(!pushed) {
+                while(!global.Push(std::move(task))) {
+                    std::this_thread::yield();  // 全局队列满，等待消费
+                }
+            }
+            // 与休眠方的 sleepers++ / 再次检查 构成Dekker式同步，保证不丢唤醒
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(sleepers.load(std::memory_order_relaxed) > 0) {
+                std::lock_guard<std::mutex> locker(mtx);
+                cond.notify_one();
+            }
+        }
+
+        // 按 本地 -> 全局 -> 窃取 的顺序取一个任务
+        bool TryGet(int idx, Task& task) {
+            Task::Raw raw;
+            if(locals[idx]->Pop(raw)) {
+                task = Task(raw);
+                return true;
+            }
+            if(global.Pop(task)) {
+                return true;
+            }
+            size_t n = locals.size();
+            for(size_t k = 1; k < n; k++) {
+                if(locals[(idx + k) % n]->Steal(raw)) {
+                    task = Task(raw);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool HasWork() const {
+            if(!global.Empty()) { return true; }
+            for(auto& q: locals) {
+                if(!q->Empty()) { return true; }
+            }
+            return false;
+        }
+
+        void Run(int idx) {
+            Current() = this;
+            CurrentIndex() = idx;
+            Task task;
+            while(true) {
+                if(TryGet(idx, task)) {
+                    task();         // 执行任务
+                    continue;
+                }
+                // 先自旋，短暂空闲时避免进出futex
+                bool got = false;
+                for(int i = 0; i < SPIN_COUNT && !got; i++) {
+                    std::this_thread::yield();
+                    got = TryGet(idx, task);
+                }
+                if(got) {
+                    task();
+                    continue;
+                }
+                std::unique_lock<std::mutex> locker(mtx);
+                sleepers.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(HasWork()) {
+                    sleepers.fetch_sub(1, std::memory_order_relaxed);
+                    continue;
+                }
+                if(isClosed) {  // 关闭且没有剩余任务
+                    sleepers.fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                cond.wait(locker);  // 如果任务队列为空，等待
+                sleepers.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        void Close() {
+            {
+                std::lock_guard<std::mutex> locker(mtx);
+                isClosed = true;
+            }
+            cond.notify_all();  // 唤醒所有的线程
+        }
+
+        MpmcQueue<Task> global;                                 // 全局注入队列
+        std::vector<std::unique_ptr<WorkStealingDeque<Task::Raw>>> locals; // 每个工作线程的本地队列
+        std::atomic<int> sleepers;      // 休眠中的线程数
+        std::mutex mtx;                 // 仅用于休眠/唤醒
+        std::condition_variable cond;   // 条件变量
+        bool isClosed;
     };
     std::shared_ptr<Pool> pool_;
 };
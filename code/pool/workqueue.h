@@ -0,0 +1,160 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <assert.h>
+
+/*
+线程池使用的两种无锁队列
+MpmcQueue: 有界多生产者多消费者队列(Vyukov)，作为全局注入队列
+WorkStealingDeque: 工作窃取双端队列(Chase-Lev)，每个工作线程一个，
+    属主在底部压入/弹出(LIFO)，其他线程从顶部窃取(FIFO)
+*/
+
+// 有界MPMC队列，容量必须是2的幂
+template<typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity = 4096)
+        : cells_(new Cell[capacity]), mask_(capacity - 1), enqueuePos_(0), dequeuePos_(0) {
+        assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+        for(size_t i = 0; i < capacity; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // 队列满时返回false
+    bool Push(T&& item) {
+        Cell* cell;
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(dif == 0) {
+                if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+            } else if(dif < 0) {
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列空时返回false
+    bool Pop(T& item) {
+        Cell* cell;
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if(dif == 0) {
+                if(dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+            } else if(dif < 0) {
+                return false;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 近似判断是否为空(仅用于决定是否休眠)
+    bool Empty() const {
+        return enqueuePos_.load(std::memory_order_acquire) == dequeuePos_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+    static const size_t CACHELINE = 64;
+
+    // 用填充隔开生产端和消费端的下标，避免伪共享
+    std::unique_ptr<Cell[]> cells_;
+    const size_t mask_;
+    char pad0_[CACHELINE];
+    std::atomic<size_t> enqueuePos_;
+    char pad1_[CACHELINE];
+    std::atomic<size_t> dequeuePos_;
+    char pad2_[CACHELINE];
+};
+
+// Chase-Lev工作窃取队列，固定容量(2的幂)，T须可平凡复制
+// 窃取者先读元素再CAS顶部，CAS失败时读到的元素直接丢弃
+template<typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 1024)
+        : buf_(new T[capacity]), mask_(capacity - 1), top_(0), bottom_(0) {
+        assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+    }
+
+    // 属主压入，满时返回false
+    bool Push(const T& item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        if(b - t > static_cast<int64_t>(mask_)) { return false; }
+        buf_[b & mask_] = item;
+        bottom_.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 属主弹出最新压入的元素
+    bool Pop(T& item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if(t > b) {     // 已空
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = buf_[b & mask_];
+        if(t == b) {    // 最后一个元素，与窃取者竞争
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 其他线程窃取最早压入的元素
+    bool Steal(T& item) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if(t >= b) { return false; }
+        item = buf_[t & mask_];
+        return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    bool Empty() const {
+        return bottom_.load(std::memory_order_acquire) <= top_.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t CACHELINE = 64;
+
+    // 用填充隔开窃取端和属主端的下标，避免伪共享
+    std::unique_ptr<T[]> buf_;
+    const size_t mask_;
+    char pad0_[CACHELINE];
+    std::atomic<int64_t> top_;
+    char pad1_[CACHELINE];
+    std::atomic<int64_t> bottom_;
+    char pad2_[CACHELINE];
+};
+
+#endif //WORKQUEUE_H
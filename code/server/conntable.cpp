@@ -0,0 +1,40 @@
+#include "conntable.h"
+#include <new>       // bad_alloc
+#include <errno.h>
+
+// 匿名映射保证页对齐(也就满足缓存行对齐)且内容全为0，即所有槽位代数为0、连接为空
+ConnTable::ConnTable(int maxFd): slots_(nullptr), maxFd_(maxFd) {
+    assert(maxFd > 0);
+    void* mem = mmap(nullptr, sizeof(Slot) * maxFd_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED) {
+        LOG_ERROR("ConnTable mmap %d slots error:%d", maxFd_, errno);
+        throw std::bad_alloc();     // 在WebServer的初始化列表中构造，与new失败一样以异常报告
+    }
+    slots_ = static_cast<Slot*>(mem);
+}
+
+ConnTable::~ConnTable() {
+    for(int fd = 0; fd < maxFd_; fd++) {
+        delete slots_[fd].conn.load(std::memory_order_relaxed);
+    }
+    munmap(slots_, sizeof(Slot) * maxFd_);
+}
+
+HttpConn* ConnTable::Acquire(int fd, uint32_t* gen) {
+    assert(fd >= 0 && fd < maxFd_ && gen);
+    Slot& slot = slots_[fd];
+    HttpConn* conn = slot.conn.load(std::memory_order_acquire);
+    if(!conn) {
+        // fd由内核分配，同一时刻只会有一个线程拿到它，这里无需加锁
+        conn = new HttpConn();
+        slot.conn.store(conn, std::memory_order_release);
+    }
+    *gen = slot.gen.fetch_add(1, std::memory_order_acq_rel) + 1;
+    return conn;
+}
+
+bool ConnTable::Release(int fd, uint32_t gen) {
+    assert(fd >= 0 && fd < maxFd_);
+    return slots_[fd].gen.compare_exchange_strong(gen, gen + 1, std::memory_order_acq_rel);
+}
@@ -0,0 +1,51 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/mman.h>    // mmap, munmap
+
+#include "../http/httpconn.h"
+
+/*
+以fd为下标的连接表，替代unordered_map<int, HttpConn>
+只有槽位表是一次性预分配的(匿名映射，未用到的页不占物理内存)，每个槽位独占一个缓存行
+HttpConn不预先构造：每个连接约3.7KB(含两个1KB的Buffer)，按MAX_FD全部构造要常驻约240MB；
+它在某个fd第一次使用时于accept路径上创建，所以连接数爬升到新高时每个新fd仍有一次分配，
+之后一直复用，稳定状态下建立连接不再分配内存，指针在整个运行期内稳定，不会因扩容失效
+每个槽位带一个代数，连接建立和关闭时递增，事件和定时器带着代数回来时可以廉价地识别fd已被复用
+*/
+class ConnTable {
+public:
+    explicit ConnTable(int maxFd);
+    ~ConnTable();
+
+    ConnTable(const ConnTable&) = delete;
+    ConnTable& operator=(const ConnTable&) = delete;
+
+    // 为新连接占用fd对应的槽位，返回连接对象，gen带回新的代数
+    HttpConn* Acquire(int fd, uint32_t* gen);
+    // 释放代数为gen的槽位(递增代数)，之后带旧代数的事件都会被识别为过期
+    // 槽位已被释放或已属于新连接时返回false，定时器和线程池同时关闭同一连接时只有一方成功
+    bool Release(int fd, uint32_t gen);
+    // 按fd和代数取连接，代数不符时返回nullptr
+    HttpConn* Get(int fd, uint32_t gen) const {
+        if(fd < 0 || fd >= maxFd_) { return nullptr; }
+        const Slot& slot = slots_[fd];
+        if(slot.gen.load(std::memory_order_acquire) != gen) { return nullptr; }
+        return slot.conn.load(std::memory_order_acquire);
+    }
+    int MaxFd() const { return maxFd_; }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> gen;
+        std::atomic<HttpConn*> conn;
+    };
+
+    Slot* slots_;
+    int maxFd_;
+};
+
+#endif //CONN_TABLE_H
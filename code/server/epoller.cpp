@@ -13,26 +13,26 @@ Epoller::~Epoller() {
 }
 
 // 向epoll实例中添加一个文件描述符
-bool Epoller::AddFd(int fd, uint32_t events) {
+bool Epoller::AddFd(int fd, uint32_t events, uint32_t tag) {
     // 如果文件描述符小于0，则返回false
     if(fd < 0) return false;
     // 构造epoll_event结构体
     epoll_event ev = {0};
-    // 将文件描述符设置到ev结构体中
-    ev.data.fd = fd;
+    // 将文件描述符和tag打包设置到ev结构体中
+    ev.data.u64 = PackData(fd, tag);
     // 设置ev结构体中的事件
     ev.events = events;
     // 向epoll实例中添加文件描述符
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
 }
 
-bool Epoller::ModFd(int fd, uint32_t events) {
+bool Epoller::ModFd(int fd, uint32_t events, uint32_t tag) {
     // 如果fd小于0，则返回false
     if(fd < 0) return false;
     // 初始化epoll_event结构体
     epoll_event ev = {0};
-    // 将fd赋值给ev.data.fd
-    ev.data.fd = fd;
+    // 将fd和tag打包赋值给ev.data.u64
+    ev.data.u64 = PackData(fd, tag);
     // 将events赋值给ev.events
     ev.events = events;
     // 调用epoll_ctl函数，将fd修改为指定的events
@@ -56,7 +56,13 @@ int Epoller::Wait(int timeoutMs) {
 // 获取事件的fd
 int Epoller::GetEventFd(size_t i) const {
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return static_cast<int>(static_cast<uint32_t>(events_[i].data.u64));
+}
+
+// 获取事件的tag
+uint32_t Epoller::GetEventTag(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return static_cast<uint32_t>(events_[i].data.u64 >> 32);
 }
 
 // 获取事件属性
@@ -0,0 +1,459 @@
+#include "iouringpoller.h"
+#include <sys/mman.h>     // mmap
+#include <sys/syscall.h>  // __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <string.h>       // memset
+#include <algorithm>
+
+// 关注事件中io_uring poll不认识的epoll控制位
+static const uint32_t EPOLL_CTRL_BITS = EPOLLET | EPOLLONESHOT | EPOLLEXCLUSIVE | EPOLLWAKEUP;
+
+// provided buffer环的组号，只有一组
+static const unsigned short BUF_GROUP = 0;
+
+IoUringPoller::IoUringPoller(int maxEvent):
+    ringFd_(-1), features_(0), sqRing_(nullptr), sqRingSize_(0), sqes_(nullptr), sqesSize_(0),
+    sqeTail_(0), cqRing_(nullptr), cqRingSize_(0), bufRing_(nullptr), bufRingSize_(0),
+    bufData_(nullptr), bufTail_(0), waiting_(false), events_(maxEvent) {
+    assert(maxEvent > 0);
+    if(!SetupRing_(static_cast<unsigned>(maxEvent))) {
+        UnmapRing_();
+        if(ringFd_ >= 0) { close(ringFd_); }
+        ringFd_ = -1;
+        return;
+    }
+    SetupBufRing_();
+}
+
+IoUringPoller::~IoUringPoller() {
+    // 先关闭实例，内核不再往缓冲区里写，再释放内存
+    if(ringFd_ >= 0) { close(ringFd_); }
+    UnmapRing_();
+}
+
+// 创建io_uring实例并映射提交/完成队列
+bool IoUringPoller::SetupRing_(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if(ringFd_ < 0) { return false; }
+    features_ = p.features;
+    // 需要带超时的等待(EXT_ARG)、完成队列不丢事件(NODROP)以及提交时就复制好参数(SUBMIT_STABLE)，老内核回退到epoll
+    if(!(features_ & IORING_FEAT_EXT_ARG) || !(features_ & IORING_FEAT_NODROP) ||
+       !(features_ & IORING_FEAT_SUBMIT_STABLE)) {
+        return false;
+    }
+
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if(features_ & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED) { sqRing_ = nullptr; return false; }
+    if(features_ & IORING_FEAT_SINGLE_MMAP) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ringFd_, IORING_OFF_CQ_RING);
+        if(cqRing_ == MAP_FAILED) { cqRing_ = nullptr; return false; }
+    }
+    sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) { return false; }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sqeTail_ = *sqTail_;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+}
+
+// 注册recv使用的provided buffer环，失败时recv和accept退化为POLL_ADD，不影响其他功能
+bool IoUringPoller::SetupBufRing_() {
+    bufRingSize_ = BUF_CNT * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED) { return false; }
+    void* data = mmap(nullptr, static_cast<size_t>(BUF_CNT) * BUF_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(data == MAP_FAILED) {
+        munmap(ring, bufRingSize_);
+        return false;
+    }
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = BUF_CNT;
+    reg.bgid = BUF_GROUP;
+    if(syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, bufRingSize_);
+        munmap(data, static_cast<size_t>(BUF_CNT) * BUF_SIZE);
+        return false;
+    }
+    bufRing_ = static_cast<io_uring_buf_ring*>(ring);
+    bufData_ = static_cast<char*>(data);
+    for(unsigned bid = 0; bid < BUF_CNT; bid++) {
+        PutBuf_(bid);
+    }
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+    return true;
+}
+
+void IoUringPoller::UnmapRing_() {
+    if(sqes_) { munmap(sqes_, sqesSize_); sqes_ = nullptr; }
+    if(cqRing_ && cqRing_ != sqRing_) { munmap(cqRing_, cqRingSize_); }
+    cqRing_ = nullptr;
+    if(sqRing_) { munmap(sqRing_, sqRingSize_); sqRing_ = nullptr; }
+    if(bufRing_) { munmap(bufRing_, bufRingSize_); bufRing_ = nullptr; }
+    if(bufData_) { munmap(bufData_, static_cast<size_t>(BUF_CNT) * BUF_SIZE); bufData_ = nullptr; }
+}
+
+IoUringPoller::FdState* IoUringPoller::State_(int fd) {
+    if(static_cast<size_t>(fd) >= fds_.size()) {
+        fds_.resize(std::max(static_cast<size_t>(fd) + 1, fds_.size() * 2));
+    }
+    return &fds_[fd];
+}
+
+// 取一个空闲的提交项，提交队列满时先把已有的提交给内核，仍然满(内核出错)时返回nullptr
+io_uring_sqe* IoUringPoller::GetSqe_() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if(sqeTail_ - head >= sqEntries_) {
+        Flush_();
+        if(!Submit_(Unsubmitted_())) { return nullptr; }
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if(sqeTail_ - head >= sqEntries_) { return nullptr; }
+    }
+    unsigned idx = sqeTail_ & sqMask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    sqeTail_++;
+    return sqe;
+}
+
+// user_data：低32位fd，往上24位代数，最高8位操作，所以不会为0
+uint64_t IoUringPoller::UserData_(int fd, const FdState* st, OP op) const {
+    return static_cast<uint32_t>(fd) | (static_cast<uint64_t>(st->gen & 0xFFFFFF) << 32) |
+           (static_cast<uint64_t>(op) << 56);
+}
+
+bool IoUringPoller::PrepPoll_(int fd, FdState* st) {
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = st->events & ~EPOLL_CTRL_BITS;
+    sqe->user_data = st->pending = UserData_(fd, st, OP_POLL);
+    return true;
+}
+
+// 数据到达后内核才从环上取缓冲区，空闲连接不占用缓冲区
+bool IoUringPoller::PrepRecv_(int fd, FdState* st) {
+    if(!bufRing_) { return PrepPoll_(fd, st); }
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = st->pending = UserData_(fd, st, OP_RECV);
+    return true;
+}
+
+// 用sendmsg而不是writev，才能带MSG_NOSIGNAL，对端关闭时不触发SIGPIPE
+bool IoUringPoller::PrepSend_(int fd, FdState* st, const struct iovec* iov, int iovCnt) {
+    if(iovCnt <= 0) { return PrepPoll_(fd, st); }
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    if(!st->msg) { st->msg.reset(new struct msghdr); }
+    memset(st->msg.get(), 0, sizeof(struct msghdr));
+    st->msg->msg_iov = const_cast<struct iovec*>(iov);
+    st->msg->msg_iovlen = iovCnt;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(st->msg.get());
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = st->pending = UserData_(fd, st, OP_SEND);
+    return true;
+}
+
+// multishot accept与provided buffer环都是5.19加入的，环注册成功就认为支持
+bool IoUringPoller::PrepAccept_(int fd, FdState* st) {
+    if(!bufRing_) { return PrepPoll_(fd, st); }
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = st->pending = UserData_(fd, st, OP_ACCEPT);
+    return true;
+}
+
+// 按user_data取消内核中未完成的操作，取消请求本身的完成事件直接丢弃
+bool IoUringPoller::PrepCancel_(FdState* st) {
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = st->pending;
+    sqe->user_data = static_cast<uint64_t>(OP_CANCEL) << 56;
+    st->pending = 0;
+    return true;
+}
+
+// 把缓冲区放回环上，调用方负责发布bufTail_
+// 环本身就是io_uring_buf数组(尾部与第0项的resv重叠)；头文件里的bufs在C++下因空结构体占1字节而偏移了8字节，不能用
+void IoUringPoller::PutBuf_(unsigned bid) {
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(bufRing_) + (bufTail_ & (BUF_CNT - 1));
+    buf->addr = reinterpret_cast<uint64_t>(bufData_ + static_cast<size_t>(bid) * BUF_SIZE);
+    buf->len = BUF_SIZE;
+    buf->bid = static_cast<unsigned short>(bid);
+    bufTail_++;
+}
+
+// 发布本地填写的提交项
+void IoUringPoller::Flush_() {
+    if(*sqTail_ != sqeTail_) {
+        __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    }
+}
+
+// 已发布但内核还没取走的提交项数量
+unsigned IoUringPoller::Unsubmitted_() const {
+    return *sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+}
+
+// 事件循环正在处理事件时马上会回到Wait()，提交留给它批量完成；
+// 阻塞在内核中时只有提交者自己进入内核，io_uring_enter在锁外调用，不让等锁的线程陪着睡眠
+bool IoUringPoller::Commit_(std::unique_lock<std::mutex>& locker) {
+    Flush_();
+    if(!waiting_) { return true; }
+    unsigned n = Unsubmitted_();
+    locker.unlock();
+    return Submit_(n);
+}
+
+template<typename Prep>
+bool IoUringPoller::Rearm_(int fd, uint32_t events, uint32_t tag, bool add, Prep prep) {
+    if(fd < 0 || ringFd_ < 0) return false;
+    std::unique_lock<std::mutex> locker(mtx_);
+    FdState* st = State_(fd);
+    if(st->added == add) { return false; }  // 添加要求未注册，修改要求已注册
+    // ONESHOT的连接在完成事件返回后才修改，这时内核中已经没有操作，不需要取消
+    if(st->pending && !PrepCancel_(st)) { return false; }
+    st->added = true;
+    st->gen++;
+    st->events = events;
+    st->tag = tag;
+    if(!prep(st) || !Commit_(locker)) {
+        // 添加失败时调用方不会再DelFd，注册作废，已经进入提交队列的操作的完成事件按过期丢弃
+        if(add) {
+            if(!locker.owns_lock()) { locker.lock(); }
+            st = &fds_[fd];
+            st->added = false;
+            st->gen++;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool IoUringPoller::Submit_(unsigned n) {
+    while(n > 0) {
+        if(Enter_(n, 0, 0, -1) >= 0) { return true; }
+        if(errno != EINTR) { return false; }
+    }
+    return true;
+}
+
+int IoUringPoller::Enter_(unsigned toSubmit, unsigned minComplete, unsigned flags, int timeoutMs) {
+    if(!(flags & IORING_ENTER_GETEVENTS) || timeoutMs < 0) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, nullptr, 0));
+    }
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete,
+                                    flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)));
+}
+
+bool IoUringPoller::AddFd(int fd, uint32_t events, uint32_t tag) {
+    return Rearm_(fd, events, tag, true, [this, fd](FdState* st) { return PrepPoll_(fd, st); });
+}
+
+bool IoUringPoller::ModFd(int fd, uint32_t events, uint32_t tag) {
+    return Rearm_(fd, events, tag, false, [this, fd](FdState* st) { return PrepPoll_(fd, st); });
+}
+
+bool IoUringPoller::AddAccept(int fd, uint32_t events) {
+    return Rearm_(fd, events | EPOLLIN, 0, true, [this, fd](FdState* st) { return PrepAccept_(fd, st); });
+}
+
+bool IoUringPoller::AddRecv(int fd, uint32_t events, uint32_t tag) {
+    return Rearm_(fd, events | EPOLLIN, tag, true, [this, fd](FdState* st) { return PrepRecv_(fd, st); });
+}
+
+bool IoUringPoller::ModRecv(int fd, uint32_t events, uint32_t tag) {
+    return Rearm_(fd, events | EPOLLIN, tag, false, [this, fd](FdState* st) { return PrepRecv_(fd, st); });
+}
+
+bool IoUringPoller::ModSend(int fd, uint32_t events, uint32_t tag, const struct iovec* iov, int iovCnt) {
+    return Rearm_(fd, events | EPOLLOUT, tag, false,
+                  [this, fd, iov, iovCnt](FdState* st) { return PrepSend_(fd, st, iov, iovCnt); });
+}
+
+bool IoUringPoller::DelFd(int fd) {
+    if(fd < 0 || ringFd_ < 0) return false;
+    std::unique_lock<std::mutex> locker(mtx_);
+    if(static_cast<size_t>(fd) >= fds_.size() || !fds_[fd].added) { return false; }
+    FdState* st = &fds_[fd];
+    st->added = false;
+    st->gen++;
+    if(!st->pending) { return Commit_(locker); }
+    if(!PrepCancel_(st)) { return false; }
+    // 取消必须在close(fd)之前到达内核：内核持有的文件引用会让连接无法真正关闭，
+    // 未完成的send还可能读到调用方随后释放的内存
+    Flush_();
+    unsigned n = Unsubmitted_();
+    locker.unlock();
+    return Submit_(n);
+}
+
+// 一次io_uring_enter提交所有积压的请求，并等待至少一个完成事件
+int IoUringPoller::Wait(int timeoutMs) {
+    unsigned toSubmit = 0;
+    bool block = false;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        // 上一轮交给调用方的数据已经处理完，缓冲区还给内核
+        if(!lent_.empty()) {
+            for(unsigned bid: lent_) { PutBuf_(bid); }
+            lent_.clear();
+            __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+        }
+        Flush_();
+        toSubmit = Unsubmitted_();
+        bool cqEmpty = (*cqHead_ == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE));
+        block = cqEmpty && timeoutMs != 0;
+        waiting_ = block;
+    }
+    if(toSubmit > 0 || block) {
+        int ret = Enter_(toSubmit, block ? 1 : 0, block ? IORING_ENTER_GETEVENTS : 0, timeoutMs);
+        if(ret < 0 && errno != ETIME && errno != EINTR) {
+            std::lock_guard<std::mutex> locker(mtx_);
+            waiting_ = false;
+            return -1;
+        }
+    }
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    waiting_ = false;
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    bool bufPut = false;
+    while(head != tail && n < events_.size()) {
+        const io_uring_cqe* cqe = &cqes_[head & cqMask_];
+        head++;
+        OP op = static_cast<OP>(cqe->user_data >> 56);
+        int res = cqe->res;
+        int bid = (cqe->flags & IORING_CQE_F_BUFFER) ? static_cast<int>(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+        int fd = static_cast<int>(static_cast<uint32_t>(cqe->user_data));
+        FdState* st = (op != OP_CANCEL && static_cast<size_t>(fd) < fds_.size()) ? &fds_[fd] : nullptr;
+        // 已删除、已修改或已取消的操作，完成事件过期：归还缓冲区，关掉multishot accept多收的连接
+        if(!st || st->pending != cqe->user_data) {
+            if(bid >= 0) { PutBuf_(bid); bufPut = true; }
+            if(op == OP_ACCEPT && res >= 0) { close(res); }
+            continue;
+        }
+        if(!(cqe->flags & IORING_CQE_F_MORE)) { st->pending = 0; }
+
+        Event& ev = events_[n];
+        ev.data = PackData(fd, st->tag);
+        ev.res = NO_RESULT;
+        ev.buf = nullptr;
+        bool rearmed = true;
+        if(op == OP_POLL) {
+            ev.events = res < 0 ? EPOLLERR : static_cast<uint32_t>(res);
+            // io_uring的poll是一次性的，未设置EPOLLONESHOT的(timerfd、eventfd、回退后的监听套接字)自动重新注册
+            if(!(st->events & EPOLLONESHOT)) { rearmed = PrepPoll_(fd, st); }
+        } else if(op == OP_RECV) {
+            if(res > 0 && bid >= 0) {
+                ev.events = EPOLLIN;
+                ev.res = res;
+                ev.buf = bufData_ + static_cast<size_t>(bid) * BUF_SIZE;
+                lent_.push_back(static_cast<unsigned>(bid));
+                bid = -1;
+            } else if(res == 0) {
+                ev.events = EPOLLIN | EPOLLRDHUP;
+            } else if(res == -ENOBUFS) {
+                ev.events = EPOLLIN;    // 缓冲区暂时用完，作为就绪通知由调用方自己读
+            } else {
+                ev.events = EPOLLERR;
+            }
+        } else if(op == OP_SEND) {
+            ev.events = res < 0 ? EPOLLERR : EPOLLOUT;
+            if(res >= 0) { ev.res = res; }
+        } else if(op == OP_ACCEPT) {
+            // 内核不支持multishot时退化为POLL_ADD，被内核终止(如fd耗尽)时重新提交
+            if(res == -EINVAL) {
+                rearmed = PrepPoll_(fd, st);
+            } else if(!st->pending) {
+                rearmed = PrepAccept_(fd, st);
+            }
+            if(res < 0 && rearmed) { continue; }
+            ev.events = res < 0 ? EPOLLERR : EPOLLIN;
+            if(res >= 0) { ev.res = res; }
+        } else {
+            continue;
+        }
+        if(bid >= 0) { PutBuf_(bid); bufPut = true; }
+        // 重新注册失败(提交队列满且内核拒绝提交)时报告错误，不让调用方无声地丢掉这个fd
+        if(!rearmed) { ev.events |= EPOLLERR; }
+        n++;
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    if(bufPut) { __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE); }
+    return static_cast<int>(n);
+}
+
+int IoUringPoller::GetEventFd(size_t i) const {
+    assert(i < events_.size());
+    return static_cast<int>(static_cast<uint32_t>(events_[i].data));
+}
+
+uint32_t IoUringPoller::GetEventTag(size_t i) const {
+    assert(i < events_.size());
+    return static_cast<uint32_t>(events_[i].data >> 32);
+}
+
+uint32_t IoUringPoller::GetEvents(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].events;
+}
+
+int IoUringPoller::GetEventResult(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].res;
+}
+
+const char* IoUringPoller::GetEventData(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].buf;
+}
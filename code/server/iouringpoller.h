@@ -0,0 +1,134 @@
+#ifndef IOURING_POLLER_H
+#define IOURING_POLLER_H
+
+#include <linux/io_uring.h>
+#include <sys/epoll.h>   // EPOLLIN等事件位
+#include <sys/socket.h>  // msghdr
+#include <unistd.h>      // close()
+#include <assert.h>
+#include <errno.h>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include "poller.h"
+
+/*
+基于io_uring的事件后端，直接使用io_uring_setup/io_uring_enter/io_uring_register系统调用
+连接上的I/O以完成方式提交给内核：监听套接字挂一个multishot accept，读用provided buffer环上的recv，
+写用sendmsg直接发送调用方的iovec，结果随事件带回，调用方不再调用accept/readv/writev；
+timerfd、eventfd以及内核不支持上述操作时使用POLL_ADD，退化为就绪通知
+提交项填好后立即发布，事件循环在Wait()中用一次io_uring_enter批量提交并收割完成事件；
+事件循环阻塞在Wait()中时，其他线程(线程池)的提交由它们自己进入内核，代价与一次epoll_ctl相同
+*/
+class IoUringPoller : public Poller {
+public:
+    explicit IoUringPoller(int maxEvent = 1024);
+    ~IoUringPoller();
+
+    // 内核不支持io_uring时返回false，由调用方回退到epoll
+    bool IsOpen() const { return ringFd_ >= 0; }
+
+    bool AddFd(int fd, uint32_t events, uint32_t tag = 0) override;
+    bool ModFd(int fd, uint32_t events, uint32_t tag = 0) override;
+    bool DelFd(int fd) override;
+    int Wait(int timeoutMs = -1) override;
+    int GetEventFd(size_t i) const override;
+    uint32_t GetEventTag(size_t i) const override;
+    uint32_t GetEvents(size_t i) const override;
+
+    bool AddAccept(int fd, uint32_t events) override;
+    bool AddRecv(int fd, uint32_t events, uint32_t tag) override;
+    bool ModRecv(int fd, uint32_t events, uint32_t tag) override;
+    bool ModSend(int fd, uint32_t events, uint32_t tag, const struct iovec* iov, int iovCnt) override;
+    int GetEventResult(size_t i) const override;
+    const char* GetEventData(size_t i) const override;
+
+    // provided buffer环的缓冲区数量(2的幂)和大小，一次recv最多收BUF_SIZE字节
+    static const unsigned BUF_CNT = 512;
+    static const unsigned BUF_SIZE = 4096;
+
+private:
+    // 提交到内核的操作，与fd、代数一起编码在user_data中
+    enum OP { OP_NONE = 0, OP_POLL, OP_RECV, OP_SEND, OP_ACCEPT, OP_CANCEL };
+
+    // 每个文件描述符的注册状态
+    struct FdState {
+        uint32_t events = 0;    // 关注的事件(epoll位)
+        uint32_t tag = 0;       // 调用方的tag，随事件带回
+        uint32_t gen = 0;       // 代数，修改或删除后递增，用于丢弃过期的完成事件
+        bool added = false;     // 是否已注册
+        uint64_t pending = 0;   // 内核中未完成操作的user_data，0表示没有
+        std::unique_ptr<struct msghdr> msg;  // sendmsg的消息头，提交前必须保持有效，按需分配以免fds_扩容时移动
+    };
+
+    // 本轮就绪事件
+    struct Event {
+        uint64_t data;          // PackData(fd, tag)
+        uint32_t events;        // epoll事件位
+        int res;                // I/O结果，就绪通知为NO_RESULT
+        const char* buf;        // recv收到的数据
+    };
+
+    bool SetupRing_(unsigned entries);
+    bool SetupBufRing_();
+    void UnmapRing_();
+    FdState* State_(int fd);
+
+    // 以下函数需持有mtx_
+    io_uring_sqe* GetSqe_();
+    uint64_t UserData_(int fd, const FdState* st, OP op) const;
+    bool PrepPoll_(int fd, FdState* st);
+    bool PrepRecv_(int fd, FdState* st);
+    bool PrepSend_(int fd, FdState* st, const struct iovec* iov, int iovCnt);
+    bool PrepAccept_(int fd, FdState* st);
+    bool PrepCancel_(FdState* st);
+    void PutBuf_(unsigned bid);
+    void Flush_();
+    unsigned Unsubmitted_() const;
+    // 发布提交项，事件循环正阻塞在Wait()中时解锁后自己提交，否则留给下一次Wait()
+    bool Commit_(std::unique_lock<std::mutex>& locker);
+    // 修改fd的注册：取消内核中未完成的操作，更新状态后由prep提交新的操作
+    template<typename Prep>
+    bool Rearm_(int fd, uint32_t events, uint32_t tag, bool add, Prep prep);
+
+    // 提交n个提交项，被信号打断时重试，失败返回false
+    bool Submit_(unsigned n);
+    int Enter_(unsigned toSubmit, unsigned minComplete, unsigned flags, int timeoutMs);
+
+    int ringFd_;
+    unsigned features_;
+
+    // 提交队列
+    void* sqRing_;
+    size_t sqRingSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned* sqArray_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    unsigned sqeTail_;      // 本地已填写但未发布的尾部
+
+    // 完成队列
+    void* cqRing_;
+    size_t cqRingSize_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+
+    // provided buffer环，注册失败(内核低于5.19)时为空，recv和accept都退化为POLL_ADD
+    io_uring_buf_ring* bufRing_;
+    size_t bufRingSize_;
+    char* bufData_;
+    unsigned short bufTail_;
+    std::vector<unsigned> lent_;             // 上一轮交给调用方的缓冲区，下一次Wait()时归还
+
+    std::mutex mtx_;                         // 保护提交队列、缓冲区环和fds_
+    bool waiting_;                           // 事件循环是否阻塞在io_uring_enter中
+    std::vector<FdState> fds_;               // 以fd为下标的注册状态
+    std::vector<Event> events_;              // 本轮就绪事件
+};
+
+#endif //IOURING_POLLER_H
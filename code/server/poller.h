@@ -0,0 +1,56 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>      // INT_MIN
+#include <sys/epoll.h>   // EPOLLIN等事件位
+#include <sys/uio.h>     // iovec
+
+// 事件后端接口，Epoller(epoll)和IoUringPoller(io_uring)都实现它
+// 事件位统一使用epoll的定义(EPOLLIN/EPOLLOUT/EPOLLET/EPOLLONESHOT...)
+class Poller {
+public:
+    virtual ~Poller() = default;
+
+    // tag随事件原样带回(与fd一起打包在epoll_event.data.u64中)，用于识别fd复用后的过期事件
+    virtual bool AddFd(int fd, uint32_t events, uint32_t tag = 0) = 0;   // 添加文件描述符并设置关注的事件
+    virtual bool ModFd(int fd, uint32_t events, uint32_t tag = 0) = 0;   // 修改文件描述符关注的事件
+    virtual bool DelFd(int fd) = 0;                    // 移除文件描述符
+    virtual int Wait(int timeoutMs = -1) = 0;          // 等待事件发生，返回就绪事件数
+    virtual int GetEventFd(size_t i) const = 0;        // 获取第i个就绪事件的文件描述符
+    virtual uint32_t GetEventTag(size_t i) const = 0;  // 获取第i个就绪事件注册时的tag
+    virtual uint32_t GetEvents(size_t i) const = 0;    // 获取第i个就绪事件
+
+    /*
+    完成式I/O：io_uring后端直接向内核提交accept/recv/send，I/O的结果随事件一起带回，
+    调用方不必在就绪后再调用accept/readv/writev
+    下面的默认实现退化为就绪通知，事件没有结果(NO_RESULT)，由调用方自己完成I/O，所以两种后端共用一套分发逻辑
+    */
+    static const int NO_RESULT = INT_MIN;
+
+    // 添加监听套接字，完成式后端提交multishot accept，新连接的fd作为EPOLLIN事件的结果带回
+    virtual bool AddAccept(int fd, uint32_t events) { return AddFd(fd, events | EPOLLIN); }
+    // 添加连接并关注读，完成式后端提交recv，收到的字节数作为EPOLLIN事件的结果带回
+    virtual bool AddRecv(int fd, uint32_t events, uint32_t tag) { return AddFd(fd, events | EPOLLIN, tag); }
+    // 重新关注读，同AddRecv
+    virtual bool ModRecv(int fd, uint32_t events, uint32_t tag) { return ModFd(fd, events | EPOLLIN, tag); }
+    // 关注写，完成式后端提交send发送iov，发出的字节数作为EPOLLOUT事件的结果带回
+    // iov指向的内容要保持有效直到事件返回或DelFd；iovCnt为0时退化为就绪通知
+    virtual bool ModSend(int fd, uint32_t events, uint32_t tag, const struct iovec* iov, int iovCnt) {
+        (void)iov; (void)iovCnt;
+        return ModFd(fd, events | EPOLLOUT, tag);
+    }
+    // 第i个事件的I/O结果：accept得到的fd、recv/send的字节数，就绪通知为NO_RESULT
+    // 出错和对端关闭分别以EPOLLERR、EPOLLRDHUP事件报告，不作为结果
+    virtual int GetEventResult(size_t i) const { (void)i; return NO_RESULT; }
+    // 第i个recv事件收到的数据(GetEventResult个字节)，只在下一次Wait之前有效
+    virtual const char* GetEventData(size_t i) const { (void)i; return nullptr; }
+
+    // 事件数据的打包方式：高32位tag，低32位fd
+    static uint64_t PackData(int fd, uint32_t tag) {
+        return (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
+    }
+};
+
+#endif //POLLER_H
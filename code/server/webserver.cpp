@@ -6,9 +6,10 @@ WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int sqlPort, const char* sqlUser, const  char* sqlPwd,
             const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
+            bool openLog, int logLevel, int logQueSize, int reactorNum,
+            bool ioUring, int cacheMB, int accessSample):
             port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+            reactorNum_(reactorNum > 1 ? reactorNum : 1), ioUring_(ioUring), users_(new ConnTable(MAX_FD))
     {
     srcDir_ = getcwd(nullptr, 256);
     assert(srcDir_);
@@ -18,10 +19,26 @@ WebServer::WebServer(
 
     // 初始化操作
     SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);  // 连接池单例的初始化
-    // 初始化事件和初始化socket(监听)
+    FileCache::Instance()->Init(static_cast<size_t>(cacheMB > 0 ? cacheMB : 0) << 20);   // 静态文件缓存
+    // 单反应堆模式下I/O交给线程池，多反应堆模式下由各自的循环线程处理
+    if(reactorNum_ == 1) {
+        threadpool_.reset(new ThreadPool(threadNum));
+    }
+    // 初始化事件和初始化socket(监听)，每个反应堆一个监听套接字
     InitEventMode_(trigMode);
-    if(!InitSocket_()) { isClose_ = true;}
+    for(int i = 0; i < reactorNum_; i++) {
+        std::unique_ptr<Reactor> r(new Reactor);
+        r->poller = NewPoller_();
+        // 空闲超时用秒级格子，超时设得很短时格子相应变细
+        r->timer.reset(new TimingWheel(std::min(1000, std::max(1, timeoutMS_ / 16))));
+        if(!InitSocket_(r.get())) { isClose_ = true; }
+        if(timeoutMS_ > 0 && !InitTimer_(r.get())) { isClose_ = true; }
+        if(!InitWakeup_(r.get())) { isClose_ = true; }
+        reactors_.push_back(std::move(r));
+    }
 
+    // 访问日志有自己的开关(抽样比例)，与Log分开
+    AccessLog::Instance()->Init("./log", accessSample, logQueSize > 0 ? logQueSize : 1024);
     // 是否打开日志标志
     if(openLog) {
         Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
@@ -35,15 +52,48 @@ WebServer::WebServer(
             LOG_INFO("LogSys level: %d", logLevel);
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
             LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("Reactor num: %d, Poller: %s", reactorNum_, ioUring_ ? "io_uring" : "epoll");
+            LOG_INFO("FileCache: %dMB", cacheMB > 0 ? cacheMB : 0);
+            LOG_INFO("AccessLog sample: %d", accessSample);
         }
     }
 }
 
 WebServer::~WebServer() {
-    close(listenFd_);
-    isClose_ = true;
+    Stop();
+    for(auto& t: loopThreads_) {
+        if(t.joinable()) { t.join(); }
+    }
+    for(auto& r: reactors_) {
+        if(r->listenFd >= 0) { close(r->listenFd); }
+        if(r->timerFd >= 0) { close(r->timerFd); }
+        if(r->wakeFd >= 0) { close(r->wakeFd); }
+    }
     free(srcDir_);
     SqlConnPool::Instance()->ClosePool();
+    FileCache::Stats stats = FileCache::Instance()->GetStats();
+    LOG_INFO("FileCache hits:%llu misses:%llu evictions:%llu invalidations:%llu bytes:%zu entries:%zu",
+             (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+             (unsigned long long)stats.evictions, (unsigned long long)stats.invalidations,
+             stats.bytes, stats.entries);
+    Log::Stats logStats = Log::Instance()->GetStats();
+    LOG_INFO("Log lines:%llu bytes:%llu dropped lines:%llu dropped bytes:%llu blocked:%llu",
+             (unsigned long long)logStats.lines, (unsigned long long)logStats.bytes,
+             (unsigned long long)logStats.droppedLines, (unsigned long long)logStats.droppedBytes,
+             (unsigned long long)logStats.blocked);
+}
+
+// 按配置创建事件后端，io_uring不可用时回退到epoll
+std::unique_ptr<Poller> WebServer::NewPoller_() {
+    if(ioUring_) {
+        std::unique_ptr<IoUringPoller> uring(new IoUringPoller());
+        if(uring->IsOpen()) {
+            return uring;
+        }
+        ioUring_ = false;
+        LOG_WARN("io_uring unavailable, fall back to epoll!");
+    }
+    return std::unique_ptr<Poller>(new Epoller());
 }
 
 void WebServer::InitEventMode_(int trigMode) {
@@ -72,35 +122,142 @@ void WebServer::InitEventMode_(int trigMode) {
 }
 
 void WebServer::Start() {
-    int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
     if(!isClose_) { LOG_INFO("========== Server start =========="); }
-    while(!isClose_) {
-        if(timeoutMS_ > 0) {
-            timeMS = timer_->GetNextTick();     // 获取下一次的超时等待事件(至少这个时间才会有用户过期，每次关闭超时连接则需要有新的请求进来)
+    // 其余反应堆各起一个线程，reactors_[0]在当前线程运行
+    for(size_t i = 1; i < reactors_.size(); i++) {
+        loopThreads_.emplace_back(&WebServer::Loop_, this, reactors_[i].get());
+    }
+    Loop_(reactors_[0].get());
+    for(auto& t: loopThreads_) {
+        if(t.joinable()) { t.join(); }
+    }
+}
+
+void WebServer::Stop() {
+    isClose_ = true;
+    // 循环线程阻塞在Wait(-1)里，写eventfd把它们叫醒
+    for(auto& r: reactors_) {
+        if(r->wakeFd >= 0) {
+            uint64_t one = 1;
+            ssize_t ret = write(r->wakeFd, &one, sizeof(one));
+            (void)ret;
         }
-        int eventCnt = epoller_->Wait(timeMS);
+    }
+}
+
+void WebServer::Loop_(Reactor* r) {
+    while(!isClose_) {
+        // 超时由timerfd作为事件送达，不用再按最近的定时器计算等待时间
+        int eventCnt = r->poller->Wait(-1);
+        bool timerDue = false;
         for(int i = 0; i < eventCnt; i++) {
             /* 处理事件 */
-            int fd = epoller_->GetEventFd(i);
-            uint32_t events = epoller_->GetEvents(i);
-            if(fd == listenFd_) {
-                DealListen_();
+            int fd = r->poller->GetEventFd(i);
+            uint32_t events = r->poller->GetEvents(i);
+            int res = r->poller->GetEventResult(i);
+            if(fd == r->listenFd) {
+                if(events & EPOLLERR) { LOG_ERROR("Listen error!"); }
+                DealListen_(r, res);
+                continue;
+            }
+            if(fd == r->timerFd) {
+                timerDue = true;    // 先处理完这一批I/O事件
+                continue;
             }
-            else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
+            if(fd == r->wakeFd) {
+                uint64_t cnt;
+                ssize_t ret = read(r->wakeFd, &cnt, sizeof(cnt));
+                (void)ret;
+                continue;           // 回到循环条件检查isClose_
+            }
+            // 按fd直接定位槽位，代数不符说明fd已关闭或被复用，丢弃过期事件
+            uint32_t gen = r->poller->GetEventTag(i);
+            HttpConn* client = users_->Get(fd, gen);
+            if(!client) {
+                continue;
+            }
+            if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                CloseConn_(r, client, gen);
             }
             else if(events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
+                // 收到的数据只在下一次Wait之前有效，在循环线程里拷进读缓冲区
+                if(res > 0) { client->ReadDone(r->poller->GetEventData(i), res); }
+                DealRead_(r, client, gen, res);
             }
             else if(events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
+                DealWrite_(r, client, gen, res);
             } else {
                 LOG_ERROR("Unexpected event");
             }
         }
+        if(timerDue) {
+            DealTimer_(r);
+        }
+        // 有了第一个连接才开始走时
+        if(r->timerFd >= 0 && !r->timerArmed && r->timer->size() > 0) {
+            ArmTimer_(r, true);
+        }
+    }
+}
+
+bool WebServer::InitTimer_(Reactor* r) {
+    r->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(r->timerFd < 0) {
+        LOG_ERROR("Create timerfd error!");
+        return false;
+    }
+    if(!r->poller->AddFd(r->timerFd, EPOLLIN)) {
+        LOG_ERROR("Add timerfd error!");
+        close(r->timerFd);
+        r->timerFd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool WebServer::InitWakeup_(Reactor* r) {
+    r->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(r->wakeFd < 0) {
+        LOG_ERROR("Create eventfd error!");
+        return false;
+    }
+    if(!r->poller->AddFd(r->wakeFd, EPOLLIN)) {
+        LOG_ERROR("Add eventfd error!");
+        close(r->wakeFd);
+        r->wakeFd = -1;
+        return false;
+    }
+    return true;
+}
+
+void WebServer::ArmTimer_(Reactor* r, bool on) {
+    struct itimerspec spec = {};
+    if(on) {
+        // 首次到期对齐到下一个非空格子的起点，之后每格触发一次；
+        // 多等一个粗粒度时钟的精度，保证时间轮读到的时间已经跨过格子边界
+        struct timespec res = {};
+        clock_getres(CLOCK_MONOTONIC_COARSE, &res);
+        int first = r->timer->GetNextTick();
+        int tick = r->timer->TickMS();
+        first = (first < 0 ? tick : first) + static_cast<int>(res.tv_nsec / 1000000) + 1;
+        spec.it_value.tv_sec = first / 1000;
+        spec.it_value.tv_nsec = (first % 1000) * 1000000L;
+        spec.it_interval.tv_sec = tick / 1000;
+        spec.it_interval.tv_nsec = (tick % 1000) * 1000000L;
+    }
+    if(timerfd_settime(r->timerFd, 0, &spec, nullptr) < 0) {
+        LOG_ERROR("timerfd_settime error:%d", errno);
+        return;
+    }
+    r->timerArmed = on;
+}
+
+void WebServer::DealTimer_(Reactor* r) {
+    uint64_t expirations;
+    while(read(r->timerFd, &expirations, sizeof(expirations)) > 0) {}    // 清空计数，错过的格子由tick一并处理
+    r->timer->tick();
+    if(r->timer->size() == 0) {
+        ArmTimer_(r, false);    // 没有连接时不再唤醒
     }
 }
 
@@ -113,124 +270,184 @@ void WebServer::SendError_(int fd, const char*info) {
     close(fd);
 }
 
-void WebServer::CloseConn_(HttpConn* client) {
+void WebServer::CloseConn_(Reactor* r, HttpConn* client, uint32_t gen) {
     assert(client);
-    LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
+    // 必须在close之前释放槽位，fd一旦关闭就可能被新连接复用；
+    // 代数不符说明连接已被别处(定时器或循环线程)关闭，fd可能已属于新连接，不能再动它
+    if(!users_->Release(client->GetFd(), gen)) {
+        return;
+    }
+    LOG_RATE(1, HttpConn::CONN_LOG_PER_SEC, "Client[%d] quit!", client->GetFd());
+    r->poller->DelFd(client->GetFd());
     client->Close();
 }
 
 /// 添加客户端
-void WebServer::AddClient_(int fd, sockaddr_in addr) {
+void WebServer::AddClient_(Reactor* r, int fd, sockaddr_in addr) {
     // 断言fd大于0
     assert(fd > 0);
     // 初始化客户端
-    users_[fd].init(fd, addr);
+    uint32_t gen = 0;
+    HttpConn* client = users_->Acquire(fd, &gen);
+    client->init(fd, addr);
     // 如果设置了超时时间
     if(timeoutMS_ > 0) {
-        // 添加定时器
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        // 添加定时器，到期时连接已关闭或fd已被复用则什么都不做
+        r->timer->add(fd, timeoutMS_, [this, r, fd, gen]() {
+            HttpConn* conn = users_->Get(fd, gen);
+            if(conn) { CloseConn_(r, conn, gen); }
+        });
     }
-    // 添加到epoll
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
     // 设置非阻塞
     SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    // 加入事件后端开始读，代数随事件带回
+    if(!r->poller->AddRecv(fd, connEvent_, gen)) {
+        LOG_ERROR("Add client[%d] error!", fd);
+        CloseConn_(r, client, gen);
+        return;
+    }
+    LOG_RATE(1, HttpConn::CONN_LOG_PER_SEC, "Client[%d] in!", client->GetFd());
 }
 
 // 处理监听套接字，主要逻辑是accept新的套接字，并加入timer和epoller中
-void WebServer::DealListen_() {
+void WebServer::DealListen_(Reactor* r, int res) {
     // 创建一个sockaddr_in结构体，用来存储客户端的地址信息
     struct sockaddr_in addr;
     // 获取客户端地址信息的长度
     socklen_t len = sizeof(addr);
+    // 事件后端已经接受了连接，res就是新的套接字，地址另外查询
+    if(res != Poller::NO_RESULT) {
+        if(res <= 0) { return; }
+        if(getpeername(res, (struct sockaddr *)&addr, &len) < 0) {
+            memset(&addr, 0, sizeof(addr));
+        }
+        if(HttpConn::userCount >= MAX_FD || res >= MAX_FD) {
+            SendError_(res, "Server busy!");
+            LOG_RATE(2, 1, "Clients is full!");
+            return;
+        }
+        AddClient_(r, res, addr);
+        return;
+    }
     // 当监听事件被触发时，循环执行以下操作
     do {
         // 接受客户端的连接请求，返回一个新的socket描述符
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
+        int fd = accept(r->listenFd, (struct sockaddr *)&addr, &len);
         // 如果返回的socket描述符小于等于0，则说明接受连接失败
         if(fd <= 0) { return;}
         // 如果当前客户端数量已经达到最大值，则发送错误信息，并返回
-        else if(HttpConn::userCount >= MAX_FD) {
+        else if(HttpConn::userCount >= MAX_FD || fd >= MAX_FD) {
             SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
+            LOG_RATE(2, 1, "Clients is full!");
             return;
         }
         // 添加新的客户端连接
-        AddClient_(fd, addr);
+        AddClient_(r, fd, addr);
     } while(listenEvent_ & EPOLLET);
 }
 
-// 处理读事件，主要逻辑是将OnRead加入线程池的任务队列中
-void WebServer::DealRead_(HttpConn* client) {
+// 处理读事件，主要逻辑是将OnRead加入线程池的任务队列中，多反应堆模式下直接在循环线程处理
+void WebServer::DealRead_(Reactor* r, HttpConn* client, uint32_t gen, int res) {
     assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client)); // 这是一个右值，bind将参数和函数绑定
+    ExtentTime_(r, client);
+    if(!threadpool_) {
+        OnRead_(r, client, gen, res);
+        return;
+    }
+    threadpool_->AddTask([this, r, client, gen, res]() { OnRead_(r, client, gen, res); });  // 只捕获指针、代数和结果，Task内联存放，不分配内存
 }
 
-// 处理写事件，主要逻辑是将OnWrite加入线程池的任务队列中
-void WebServer::DealWrite_(HttpConn* client) {
+// 处理写事件，主要逻辑是将OnWrite加入线程池的任务队列中，多反应堆模式下直接在循环线程处理
+void WebServer::DealWrite_(Reactor* r, HttpConn* client, uint32_t gen, int res) {
     assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    ExtentTime_(r, client);
+    if(!threadpool_) {
+        OnWrite_(r, client, gen, res);
+        return;
+    }
+    threadpool_->AddTask([this, r, client, gen, res]() { OnWrite_(r, client, gen, res); });
 }
 
-void WebServer::ExtentTime_(HttpConn* client) {
+void WebServer::ExtentTime_(Reactor* r, HttpConn* client) {
     assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+    if(timeoutMS_ > 0) { r->timer->adjust(client->GetFd(), timeoutMS_); }
 }
 
-void WebServer::OnRead_(HttpConn* client) {
+void WebServer::OnRead_(Reactor* r, HttpConn* client, uint32_t gen, int res) {
     assert(client);
-    int ret = -1;
-    int readErrno = 0;
-    ret = client->read(&readErrno);         // 读取客户端套接字的数据，读到httpconn的读缓存区
-    if(ret <= 0 && readErrno != EAGAIN) {   // 读异常就关闭客户端
-        CloseConn_(client);
+    // 任务排队期间连接可能已被定时器关闭，fd甚至已被新连接复用，这时槽位里是同一个HttpConn对象
+    if(users_->Get(client->GetFd(), gen) != client) {
         return;
     }
+    // 事件后端已经把数据收进了读缓冲区，不用再读
+    if(res == Poller::NO_RESULT) {
+        int ret = -1;
+        int readErrno = 0;
+        ret = client->read(&readErrno);         // 读取客户端套接字的数据，读到httpconn的读缓存区
+        if(ret <= 0 && readErrno != EAGAIN) {   // 读异常就关闭客户端
+            CloseConn_(r, client, gen);
+            return;
+        }
+    }
     // 业务逻辑的处理（先读后处理）
-    OnProcess(client);
+    OnProcess(r, client, gen);
 }
 
 /* 处理读（请求）数据的函数 */
-void WebServer::OnProcess(HttpConn* client) {
+void WebServer::OnProcess(Reactor* r, HttpConn* client, uint32_t gen) {
     // 首先调用process()进行逻辑处理
     if(client->process()) { // 根据返回的信息重新将fd置为EPOLLOUT（写）或EPOLLIN（读）
     //读完事件就跟内核说可以写了
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);    // 响应成功，修改监听事件为写,等待OnWrite_()发送
-    } else {
+        ArmWrite_(r, client, gen);    // 响应成功，修改监听事件为写,等待OnWrite_()发送
+    } else if(!r->poller->ModRecv(client->GetFd(), connEvent_, gen)) {
     //写完事件就跟内核说可以读了
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        LOG_ERROR("Rearm client[%d] read error!", client->GetFd());
+        CloseConn_(r, client, gen);
     }
 }
 
-void WebServer::OnWrite_(HttpConn* client) {
+void WebServer::ArmWrite_(Reactor* r, HttpConn* client, uint32_t gen) {
+    const struct iovec* iov = nullptr;
+    int iovCnt = client->WriteIov(&iov);
+    if(!r->poller->ModSend(client->GetFd(), connEvent_, gen, iov, iovCnt)) {
+        LOG_ERROR("Rearm client[%d] write error!", client->GetFd());
+        CloseConn_(r, client, gen);
+    }
+}
+
+void WebServer::OnWrite_(Reactor* r, HttpConn* client, uint32_t gen, int res) {
     assert(client);
+    if(users_->Get(client->GetFd(), gen) != client) {
+        return;
+    }
     int ret = -1;
     int writeErrno = 0;
-    ret = client->write(&writeErrno);
+    if(res == Poller::NO_RESULT) {
+        ret = client->write(&writeErrno);
+    } else {
+        client->WriteDone(res);     // 事件后端已经发出了res字节
+        ret = res;
+    }
     if(client->ToWriteBytes() == 0) {
         /* 传输完成 */
         if(client->IsKeepAlive()) {
-            // OnProcess(client);
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN); // 回归换成监测读事件
+            // 读缓冲区里可能还有流水线请求，先处理它们，没有完整请求时会回归监测读事件
+            OnProcess(r, client, gen);
             return;
         }
     }
-    else if(ret < 0) {
-        if(writeErrno == EAGAIN) {  // 缓冲区满了 
-            /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
-            return;
-        }
+    else if(ret > 0 || writeErrno == EAGAIN) {
+        /* 缓冲区满了，或LT模式下只写了一部分：继续传输 */
+        ArmWrite_(r, client, gen);
+        return;
     }
-    CloseConn_(client);
+    CloseConn_(r, client, gen);
 }
 
 /* Create listenFd */
-bool WebServer::InitSocket_() {
+bool WebServer::InitSocket_(Reactor* r) {
     int ret;
+    int listenFd;
     struct sockaddr_in addr;
     // 判断端口号是否合法
     if(port_ > 65535 || port_ < 1024) {
@@ -252,17 +469,17 @@ bool WebServer::InitSocket_() {
         }
 
         // 创建套接字
-        listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
-        if(listenFd_ < 0) {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if(listenFd < 0) {
             LOG_ERROR("Create socket error!", port_);
             return false;
         }
 
         // 设置套接字选项
         //设置套接字选项SO_LINGER，如果设置失败，则关闭套接字，并输出错误信息
-        ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));     
+        ret = setsockopt(listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));     
         if(ret < 0) {
-            close(listenFd_);
+            close(listenFd);
             LOG_ERROR("Init linger error!", port_);
             return false;
         }
@@ -272,37 +489,47 @@ bool WebServer::InitSocket_() {
     int optval = 1;
     /* 端口复用 */
     /* 只有最后一个套接字会正常接收数据。 */
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int)); //设置 SO_REUSEADDR 选项，允许端口复用。
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int)); //设置 SO_REUSEADDR 选项，允许端口复用。
     if(ret == -1) {
         LOG_ERROR("set socket setsockopt error !");
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
+    /* 多反应堆模式下每个反应堆各自监听同一端口，由内核在这些套接字间均衡分发新连接 */
+    if(reactorNum_ > 1) {
+        ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
+        if(ret == -1) {
+            LOG_ERROR("set socket SO_REUSEPORT error !");
+            close(listenFd);
+            return false;
+        }
+    }
 
     // 绑定
-    ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr));
+    ret = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
     if(ret < 0) {
         LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
     // 监听
-    ret = listen(listenFd_, 6);
+    ret = listen(listenFd, 6);
     if(ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
-    // 将监听套接字加入epoller
-    ret = epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
+    // 将监听套接字加入事件后端
+    ret = r->poller->AddAccept(listenFd, listenEvent_);
     if(ret == 0) {
         LOG_ERROR("Add listen error!");
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
     // 将监听套接字设置为非阻塞
-    SetFdNonblock(listenFd_);   
+    SetFdNonblock(listenFd);   
+    r->listenFd = listenFd;
     LOG_INFO("Server port:%d", port_);
     return true;
 }
@@ -1,7 +1,9 @@
 #ifndef WEBSERVER_H
 #define WEBSERVER_H
 
-#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <atomic>
 #include <fcntl.h>       // fcntl()
 #include <unistd.h>      // close()
 #include <assert.h>
@@ -9,9 +11,13 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 
 #include "epoller.h"
-#include "../timer/heaptimer.h"
+#include "iouringpoller.h"
+#include "conntable.h"
+#include "../timer/timingwheel.h"
 
 #include "../log/log.h"
 #include "../pool/sqlconnpool.h"
@@ -25,38 +31,68 @@ public:
         int port, int trigMode, int timeoutMS, bool OptLinger, 
         int sqlPort, const char* sqlUser, const  char* sqlPwd, 
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+        bool openLog, int logLevel, int logQueSize, int reactorNum = 1,
+        bool ioUring = false, int cacheMB = 64, int accessSample = 0);
 
     ~WebServer();
     void Start();
+    // 让所有事件循环退出，Start()随后返回，可以从其他线程调用
+    void Stop();
 
 private:
-    bool InitSocket_(); 
+    // 反应堆：一个事件循环独占的监听套接字、事件后端和定时器
+    struct Reactor {
+        int listenFd = -1;
+        std::unique_ptr<Poller> poller;
+        std::unique_ptr<TimingWheel> timer;
+        int timerFd = -1;           // 驱动时间轮的timerfd，到期作为普通读事件返回
+        bool timerArmed = false;    // timerfd是否在按格子周期触发
+        int wakeFd = -1;            // 关闭时写入eventfd，把阻塞在Wait里的循环叫醒
+    };
+
+    bool InitSocket_(Reactor* r); 
+    // 创建事件后端
+    std::unique_ptr<Poller> NewPoller_();
+    // 事件循环
+    void Loop_(Reactor* r);
     // 初始化事件模式
     void InitEventMode_(int trigMode);
     // 添加客户端
-    void AddClient_(int fd, sockaddr_in addr);
+    void AddClient_(Reactor* r, int fd, sockaddr_in addr);
   
+    // 以下函数的res是事件后端以完成方式带回的I/O结果(新连接的fd、收发的字节数)，
+    // 为Poller::NO_RESULT时只是就绪通知，自己调用accept/read/write
     // 处理监听
-    void DealListen_();
+    void DealListen_(Reactor* r, int res);
     // 处理写入
-    void DealWrite_(HttpConn* client);
+    void DealWrite_(Reactor* r, HttpConn* client, uint32_t gen, int res);
     // 处理读取
-    void DealRead_(HttpConn* client);
+    void DealRead_(Reactor* r, HttpConn* client, uint32_t gen, int res);
 
     // 发送错误
     void SendError_(int fd, const char*info);
     // 延长连接时间
-    void ExtentTime_(HttpConn* client);
-    // 关闭连接
-    void CloseConn_(HttpConn* client);
+    void ExtentTime_(Reactor* r, HttpConn* client);
+    // 创建timerfd并加入事件后端
+    bool InitTimer_(Reactor* r);
+    // 创建用于叫醒事件循环的eventfd并加入事件后端
+    bool InitWakeup_(Reactor* r);
+    // 时间轮非空时让timerfd对齐到格子边界周期触发，为空时停止
+    void ArmTimer_(Reactor* r, bool on);
+    // timerfd到期：处理时间轮中所有到期的定时器
+    void DealTimer_(Reactor* r);
+    // 关闭代数为gen的连接，已经被关闭过(fd可能已被复用)时什么都不做
+    void CloseConn_(Reactor* r, HttpConn* client, uint32_t gen);
 
+    // 以下三个函数的gen是事件分发时连接的代数，重新注册事件时沿用它，不读取槽位当前的代数
     // 读取事件
-    void OnRead_(HttpConn* client);
+    void OnRead_(Reactor* r, HttpConn* client, uint32_t gen, int res);
     // 写入事件
-    void OnWrite_(HttpConn* client);
+    void OnWrite_(Reactor* r, HttpConn* client, uint32_t gen, int res);
     // 处理请求
-    void OnProcess(HttpConn* client);
+    void OnProcess(Reactor* r, HttpConn* client, uint32_t gen);
+    // 关注写：把待发送的数据交给事件后端，失败时关闭连接
+    void ArmWrite_(Reactor* r, HttpConn* client, uint32_t gen);
 
     // 最大文件描述符
     static const int MAX_FD = 65536;
@@ -70,10 +106,12 @@ private:
     bool openLinger_;
     // 超时时间，毫秒
     int timeoutMS_;  /* 毫秒MS */
-    // 是否关闭
-    bool isClose_;
-    // 监听文件描述符
-    int listenFd_;
+    // 是否关闭，析构时由其他线程设置，各循环线程读取
+    std::atomic<bool> isClose_;
+    // 反应堆数量，大于1时每个线程一个事件循环，I/O在循环线程内直接处理
+    int reactorNum_;
+    // 事件后端是否使用io_uring(不可用时回退到epoll)
+    bool ioUring_;
     // 源目录
     char* srcDir_;
     
@@ -82,14 +120,14 @@ private:
     // 连接事件
     uint32_t connEvent_;    // 连接事件
    
-    // 堆定时器
-    std::unique_ptr<HeapTimer> timer_;
-    // 线程池
+    // 线程池（单反应堆模式）
     std::unique_ptr<ThreadPool> threadpool_;
-    // epoll
-    std::unique_ptr<Epoller> epoller_;
-    // 用户
-    std::unordered_map<int, HttpConn> users_;
+    // 反应堆，reactors_[0]运行在调用Start()的线程上
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+    // 其余反应堆的线程
+    std::vector<std::thread> loopThreads_;
+    // 用户连接表，以fd为下标，所有反应堆共享(fd由内核保证唯一)
+    std::unique_ptr<ConnTable> users_;
 };
 
 #endif //WEBSERVER_H
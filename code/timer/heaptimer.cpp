@@ -1,5 +1,7 @@
 #include "heaptimer.h"
 
+using namespace std;
+
 void HeapTimer::SwapNode_(size_t i, size_t j) {
     // 交换两个结点
     assert(i >= 0 && i <heap_.size());
@@ -13,16 +15,14 @@ void HeapTimer::SwapNode_(size_t i, size_t j) {
 void HeapTimer::siftup_(size_t i) {
     // 断言i在堆的范围内
     assert(i >= 0 && i < heap_.size());
-    // 计算父节点的索引
-    size_t parent = (i-1) / 2;
-    // 当父节点的索引大于0时，循环
-    while(parent >= 0) {
+    // 到达堆顶(i为0)时停止，size_t下(0-1)/2不是合法下标
+    while(i > 0) {
+        // 计算父节点的索引
+        size_t parent = (i-1) / 2;
         // 如果父节点的优先级大于子节点的优先级，交换它们的位置
         if(heap_[parent] > heap_[i]) {
             SwapNode_(i, parent);
-            // 更新i和父节点的索引
             i = parent;
-            parent = (i-1)/2;
         } else {
             // 否则退出循环
             break;
@@ -40,12 +40,12 @@ bool HeapTimer::siftdown_(size_t i, size_t n) {
         if(child+1 < n && heap_[child+1] < heap_[child]) {
             child++;
         }
-        if(heap_[child] < heap_[index]) {
-            SwapNode_(index, child);
-            index = child;
-            child = 2*child+1;
+        if(!(heap_[child] < heap_[index])) {
+            break;  // 子结点都不比它早，已满足堆性质
         }
-        break;  // 需要跳出循环
+        SwapNode_(index, child);
+        index = child;
+        child = 2*child+1;
     }
     return index > i;
 }
@@ -0,0 +1,148 @@
+#include "timingwheel.h"
+
+TimingWheel::TimingWheel(int tickMS, size_t slots):
+    tickMS_(tickMS > 0 ? tickMS : 1), slots_(slots > 0 ? slots : 1, -1),
+    curTick_(NowMs_() / tickMS_), count_(0) {}
+
+// 粗粒度单调时钟走vDSO，精度(几毫秒)对秒级的格子足够
+int64_t TimingWheel::NowMs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+void TimingWheel::Link_(int id) {
+    Node& node = nodes_[id];
+    int64_t tick = node.expires / tickMS_;
+    if(tick <= curTick_) {
+        tick = curTick_ + 1;    // 所在格子已经处理过，放到下一个格子
+    }
+    size_t slot = static_cast<size_t>(tick % static_cast<int64_t>(slots_.size()));
+    node.slot = static_cast<int>(slot);
+    node.prev = -1;
+    node.next = slots_[slot];
+    if(node.next >= 0) { nodes_[node.next].prev = id; }
+    slots_[slot] = id;
+}
+
+void TimingWheel::Unlink_(int id) {
+    Node& node = nodes_[id];
+    assert(node.slot >= 0);
+    if(node.prev >= 0) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        slots_[node.slot] = node.next;
+    }
+    if(node.next >= 0) { nodes_[node.next].prev = node.prev; }
+    node.prev = node.next = node.slot = -1;
+}
+
+void TimingWheel::add(int id, int timeOut, const TimeoutCallBack& cb) {
+    assert(id >= 0);
+    if(static_cast<size_t>(id) >= nodes_.size()) {
+        nodes_.resize(id + 1);
+    }
+    Node& node = nodes_[id];
+    if(node.slot >= 0) {
+        Unlink_(id);
+    } else {
+        count_++;
+    }
+    node.expires = NowMs_() + timeOut;
+    node.cb = cb;
+    Link_(id);
+}
+
+void TimingWheel::adjust(int id, int newExpires) {
+    assert(static_cast<size_t>(id) < nodes_.size() && nodes_[id].slot >= 0);
+    Node& node = nodes_[id];
+    int64_t expires = NowMs_() + newExpires;
+    if(expires >= node.expires) {
+        node.expires = expires;     // 延后：格子到期时再重新挂入
+        return;
+    }
+    // 提前：必须挂到更早的格子
+    node.expires = expires;
+    Unlink_(id);
+    Link_(id);
+}
+
+void TimingWheel::cancel(int id) {
+    if(id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].slot < 0) {
+        return;
+    }
+    Unlink_(id);
+    nodes_[id].cb = nullptr;
+    count_--;
+}
+
+void TimingWheel::doWork(int id) {
+    if(id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].slot < 0) {
+        return;
+    }
+    TimeoutCallBack cb = std::move(nodes_[id].cb);
+    cancel(id);
+    cb();
+}
+
+void TimingWheel::Expire_(size_t slot, int64_t now) {
+    int id = slots_[slot];
+    while(id >= 0) {
+        int next = nodes_[id].next;     // 重新挂入的节点插在表头，不会再次遍历到
+        Unlink_(id);
+        if(nodes_[id].expires <= now) {
+            count_--;
+            expired_.push_back(id);
+        } else {
+            Link_(id);
+        }
+        id = next;
+    }
+}
+
+void TimingWheel::tick() {
+    int64_t now = NowMs_();
+    int64_t tick = now / tickMS_;
+    if(tick <= curTick_) {
+        return;
+    }
+    // 停顿超过一圈时每个格子只需处理一次
+    int64_t from = std::max(curTick_ + 1, tick - static_cast<int64_t>(slots_.size()) + 1);
+    curTick_ = tick;
+    expired_.clear();
+    for(int64_t t = from; t <= tick; t++) {
+        Expire_(static_cast<size_t>(t % static_cast<int64_t>(slots_.size())), now);
+    }
+    // 全部摘下后再回调，回调中可以安全地添加或删除定时器
+    for(size_t i = 0; i < expired_.size(); i++) {
+        int id = expired_[i];
+        if(nodes_[id].slot >= 0) { continue; }      // 被前面的回调重新添加了
+        TimeoutCallBack cb = std::move(nodes_[id].cb);
+        nodes_[id].cb = nullptr;
+        if(cb) { cb(); }
+    }
+}
+
+int TimingWheel::GetNextTick() {
+    tick();
+    if(count_ == 0) {
+        return -1;
+    }
+    // 找下一个非空格子，等到它的起始时刻
+    int64_t now = NowMs_();
+    for(size_t i = 1; i <= slots_.size(); i++) {
+        int64_t t = curTick_ + i;
+        if(slots_[static_cast<size_t>(t % static_cast<int64_t>(slots_.size()))] >= 0) {
+            int64_t wait = t * tickMS_ - now;
+            return wait > 0 ? static_cast<int>(wait) : 0;
+        }
+    }
+    return tickMS_;
+}
+
+void TimingWheel::clear() {
+    for(auto& head: slots_) { head = -1; }
+    nodes_.clear();
+    expired_.clear();
+    count_ = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <vector>
+#include <time.h>       // clock_gettime
+#include <assert.h>
+#include "heaptimer.h"  // TimeoutCallBack
+
+/*
+哈希时间轮，用于连接的空闲超时
+时间按tickMS分成格子，slots个格子组成一圈，定时器挂在到期时间所在格子的双向链表上
+定时器以id(文件描述符)为下标存放在数组中，添加、删除都是O(1)
+刷新是惰性的：只记下新的到期时间，不移动节点；格子到期时再检查，没到期的重新挂到对应格子
+超过一圈的定时器同样在经过时重新挂入，相当于逐层下放的分层时间轮
+到期时间最多比设定的晚一个tickMS，不会提前
+*/
+class TimingWheel {
+public:
+    explicit TimingWheel(int tickMS = 1000, size_t slots = 64);
+    ~TimingWheel() { clear(); }
+
+    // 刷新指定id的到期时间(newExpires毫秒后)，延后时只记录时间
+    void adjust(int id, int newExpires);
+    // 添加定时器，id已存在时替换其到期时间和回调
+    void add(int id, int timeOut, const TimeoutCallBack& cb);
+    // 删除定时器，不执行回调
+    void cancel(int id);
+    // 执行指定id的回调并删除
+    void doWork(int id);
+    // 清除所有定时器
+    void clear();
+    // 处理到期的定时器，只读一次时钟
+    void tick();
+    // 处理到期的定时器，并返回距离下一个非空格子的毫秒数，没有定时器时返回-1
+    int GetNextTick();
+    // 当前定时器数量
+    size_t size() const { return count_; }
+    // 格子的时间跨度
+    int TickMS() const { return tickMS_; }
+
+private:
+    struct Node {
+        int64_t expires = 0;    // 到期时间(毫秒)，刷新时只改这里
+        int prev = -1;          // 格子链表中的前后节点id
+        int next = -1;
+        int slot = -1;          // 所在格子，-1表示不在时间轮中
+        TimeoutCallBack cb;
+    };
+
+    static int64_t NowMs_();
+    // 挂到到期时间对应的格子，已经到期的挂到下一个格子
+    void Link_(int id);
+    void Unlink_(int id);
+    // 处理一个格子：到期的取出等待回调，没到期的重新挂入
+    void Expire_(size_t slot, int64_t now);
+
+    const int tickMS_;
+    std::vector<int> slots_;        // 每个格子链表的表头id
+    std::vector<Node> nodes_;       // 以id为下标
+    std::vector<int> expired_;      // 本次tick到期的id，复用避免分配
+    int64_t curTick_;               // 已经处理到的格子序号(now / tickMS)
+    size_t count_;
+};
+
+#endif //TIMING_WHEEL_H
@@ -0,0 +1,400 @@
+#include "../code/pool/threadpool.h"
+#include "../code/http/httprequest.h"
+#include "../code/timer/heaptimer.h"
+#include "../code/timer/timingwheel.h"
+#include "../code/log/log.h"
+#include "../code/log/accesslog.h"
+#include <queue>
+#include <regex>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// 统计全局operator new的调用次数，用来衡量每个请求的内存分配
+static std::atomic<long> g_allocs(0);
+
+void* operator new(size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(n ? n : 1);
+    if(!p) { throw std::bad_alloc(); }
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double ElapsedMs(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+}
+
+// 模拟WebServer::DealRead_提交的任务：对象指针 + 反应堆指针 + 连接指针
+struct FakeServer {
+    std::atomic<long> done{0};
+    void OnRead_(void* r, void* client) { (void)r; (void)client; done.fetch_add(1, std::memory_order_relaxed); }
+};
+
+// 原来的派发方式：std::bind包成std::function，放进互斥锁保护的std::queue
+static void BenchDispatchLegacy(int n) {
+    FakeServer server;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mtx;
+    int r = 0, client = 0;
+    long before = g_allocs.load();
+    auto start = BenchClock::now();
+    for(int i = 0; i < n; i++) {
+        {
+            std::lock_guard<std::mutex> locker(mtx);
+            tasks.emplace(std::bind(&FakeServer::OnRead_, &server, (void*)&r, (void*)&client));
+        }
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> locker(mtx);
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+    double ms = ElapsedMs(start);
+    printf("dispatch legacy  (bind+function): %.2f allocs/task, %.1f ns/task\n",
+           double(g_allocs.load() - before) / n, ms * 1e6 / n);
+}
+
+// 现在的派发方式：只捕获指针的lambda放进Task，经过工作窃取线程池执行
+static void BenchDispatchTask(int n) {
+    FakeServer server;
+    int r = 0, client = 0;
+    void* rp = &r;
+    void* cp = &client;
+    FakeServer* sp = &server;
+    ThreadPool pool(4);
+    long before = g_allocs.load();
+    auto start = BenchClock::now();
+    for(int i = 0; i < n; i++) {
+        pool.AddTask([sp, rp, cp]() { sp->OnRead_(rp, cp); });
+    }
+    while(server.done.load() < n) {
+        std::this_thread::yield();
+    }
+    double ms = ElapsedMs(start);
+    printf("dispatch Task    (lambda+pool)  : %.2f allocs/task, %.1f ns/task\n",
+           double(g_allocs.load() - before) / n, ms * 1e6 / n);
+}
+
+// 浏览器实际发出的请求头
+static const char BROWSER_REQUEST[] =
+    "GET /css/style.css HTTP/1.1\r\n"
+    "Host: 192.168.1.20:1316\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Referer: http://192.168.1.20:1316/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; session=3f2a9c0e8b7d4a1f9e6c5b4a3d2e1f0a; theme=dark; _ga_XYZ=GS1.1.1700000000.5.1.1700000500.0.0.0\r\n"
+    "If-None-Match: \"65a1b2c3-2653\"\r\n"
+    "If-Modified-Since: Mon, 15 Jul 2024 08:00:00 GMT\r\n"
+    "\r\n";
+
+// 原来的解析方式：每行拷贝成string，每次调用现场构造std::regex
+struct LegacyRequest {
+    std::string method, path, version;
+    std::unordered_map<std::string, std::string> header;
+};
+
+static bool LegacyParse(Buffer& buff, LegacyRequest& req) {
+    const char CRLF[] = "\r\n";
+    int state = 0;
+    while(buff.ReadableBytes() && state != 3) {
+        const char* lineEnd = std::search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
+        std::string line(buff.Peek(), lineEnd);
+        std::smatch subMatch;
+        if(state == 0) {
+            std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+            if(!std::regex_match(line, subMatch, patten)) { return false; }
+            req.method = subMatch[1];
+            req.path = subMatch[2];
+            req.version = subMatch[3];
+            state = 1;
+        } else if(state == 1) {
+            std::regex patten("^([^:]*): ?(.*)$");
+            if(std::regex_match(line, subMatch, patten)) {
+                req.header[subMatch[1]] = subMatch[2];
+            } else {
+                state = 2;
+            }
+            if(buff.ReadableBytes() <= 2) { state = 3; }
+        } else {
+            state = 3;
+        }
+        if(lineEnd == buff.BeginWrite()) { break; }
+        buff.RetrieveUntil(lineEnd + 2);
+    }
+    return true;
+}
+
+static void BenchParseLegacy(int n) {
+    Buffer buff;
+    LegacyRequest req;
+    auto start = BenchClock::now();
+    for(int i = 0; i < n; i++) {
+        buff.RetrieveAll();
+        buff.Append(BROWSER_REQUEST, sizeof(BROWSER_REQUEST) - 1);
+        req.header.clear();
+        LegacyParse(buff, req);
+    }
+    double ms = ElapsedMs(start);
+    printf("parse legacy (regex)      : %.0f req/s/core, %.2f us/req\n", n / ms * 1000, ms * 1000 / n);
+}
+
+static void BenchParseStateMachine(int n) {
+    Buffer buff;
+    HttpRequest req;
+    long before = g_allocs.load();
+    auto start = BenchClock::now();
+    for(int i = 0; i < n; i++) {
+        buff.RetrieveAll();
+        buff.Append(BROWSER_REQUEST, sizeof(BROWSER_REQUEST) - 1);
+        req.Init();
+        req.parse(buff);
+    }
+    double ms = ElapsedMs(start);
+    printf("parse state machine       : %.0f req/s/core, %.2f us/req, %.2f allocs/req\n",
+           n / ms * 1000, ms * 1000 / n, double(g_allocs.load() - before) / n);
+}
+
+// 抓包得到的几类典型请求头，作为扫描基准的语料
+static const char* const HEADER_CORPUS[] = {
+    BROWSER_REQUEST,
+    // Firefox
+    "GET /images/profile-image.jpg HTTP/1.1\r\n"
+    "Host: 192.168.1.20:1316\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:126.0) Gecko/20100101 Firefox/126.0\r\n"
+    "Accept: image/avif,image/webp,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://192.168.1.20:1316/picture.html\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Priority: u=5, i\r\n"
+    "\r\n",
+    // Safari
+    "GET /video.html HTTP/1.1\r\n"
+    "Host: 192.168.1.20:1316\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.4.1 Safari/605.1.15\r\n"
+    "Accept-Language: zh-CN,zh-Hans;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n",
+    // curl
+    "GET / HTTP/1.1\r\n"
+    "Host: 127.0.0.1:1316\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+    // 带大量跟踪cookie的请求
+    "GET /welcome.html HTTP/1.1\r\n"
+    "Host: 192.168.1.20:1316\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36 Edg/124.0.0.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; _gid=GA1.1.987654321.1700000000; _fbp=fb.1.1700000000000.1234567890; "
+    "_gcl_au=1.1.1234567890.1700000000; session=3f2a9c0e8b7d4a1f9e6c5b4a3d2e1f0a9b8c7d6e5f4a3b2c1d0e9f8a7b6c5d4e; "
+    "csrftoken=Zx9Yw8Vu7Ts6Rq5Po4Nm3Lk2Ji1Hg0FeDcBa; theme=dark; lang=zh-CN; tz=Asia%2FShanghai; "
+    "_ga_ABCDEF1234=GS1.1.1700000000.12.1.1700000900.0.0.0; __cf_bm=abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJ-1700000000-0-AQ==\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8,en-GB;q=0.7,en-US;q=0.6\r\n"
+    "\r\n",
+};
+
+// 对每种扫描实现：按行切分整个语料并检查非法字符的吞吐量，以及完整解析的速度
+static void BenchHttpScan(int rounds) {
+    size_t corpusBytes = 0;
+    for(const char* req: HEADER_CORPUS) { corpusBytes += strlen(req); }
+    HttpScan::ISA best = HttpScan::Current();
+    for(HttpScan::ISA isa: {HttpScan::SCALAR, HttpScan::SSE42, HttpScan::AVX2}) {
+        if(!HttpScan::Use(isa)) { continue; }
+        size_t lines = 0;
+        auto start = BenchClock::now();
+        for(int r = 0; r < rounds; r++) {
+            for(const char* req: HEADER_CORPUS) {
+                const char* p = req;
+                const char* end = req + strlen(req);
+                while(p < end) {
+                    const char* lineEnd = HttpScan::FindCRLF(p, end);
+                    lines += (HttpScan::FindInvalid(p, lineEnd) == lineEnd);
+                    HttpScan::FindChar(p, lineEnd, ':');
+                    p = lineEnd + 2;
+                }
+            }
+        }
+        double scanMs = ElapsedMs(start);
+
+        Buffer buff;
+        HttpRequest req;
+        start = BenchClock::now();
+        for(int r = 0; r < rounds; r++) {
+            for(const char* text: HEADER_CORPUS) {
+                buff.RetrieveAll();
+                buff.Append(text, strlen(text));
+                req.Init();
+                req.parse(buff);
+            }
+        }
+        double parseMs = ElapsedMs(start);
+        size_t reqs = size_t(rounds) * (sizeof(HEADER_CORPUS) / sizeof(HEADER_CORPUS[0]));
+        printf("scan %-7s: %7.0f MB/s (%zu lines), parse %.0f req/s/core\n", HttpScan::Name(isa),
+               corpusBytes * double(rounds) / scanMs / 1000, lines / rounds, reqs / parseMs * 1000);
+    }
+    HttpScan::Use(best);
+    printf("scan dispatch picked: %s\n", HttpScan::Name(best));
+}
+
+// 模拟空闲超时：conns个连接各挂一个60s的定时器，之后每个读写事件刷新一次，每批事件后事件循环取一次等待时间
+template<typename Timer>
+static void BenchTimer(const char* name, Timer& timer, int conns, int events) {
+    std::vector<int> ids(events);
+    srand(3);
+    for(auto& id: ids) { id = rand() % conns; }
+    int closed = 0;
+    long before = g_allocs.load();
+    auto start = BenchClock::now();
+    for(int fd = 0; fd < conns; fd++) {
+        timer.add(fd, 60000, [&closed]() { closed++; });
+    }
+    double addMs = ElapsedMs(start);
+    long addAllocs = g_allocs.load() - before;
+
+    before = g_allocs.load();
+    start = BenchClock::now();
+    for(int i = 0; i < events; i++) {
+        timer.adjust(ids[i], 60000);
+        if((i & 63) == 63) { timer.GetNextTick(); }
+    }
+    double adjustMs = ElapsedMs(start);
+    printf("%-12s %d conns: add %6.1f ns (%.1f allocs), refresh+loop %6.1f ns (%.2f allocs)\n", name, conns,
+           addMs * 1e6 / conns, double(addAllocs) / conns,
+           adjustMs * 1e6 / events, double(g_allocs.load() - before) / events);
+}
+
+// 调用线程上每条日志的耗时：普通模式在调用线程格式化，延迟模式只拷贝参数
+// 每批之后flush，保证缓冲区不满、没有丢弃，只统计调用线程的时间
+static void BenchLog(const char* name, bool deferred, int n) {
+    Log::Instance()->init(1, "./benchlog", ".log", 1 << 14, deferred);
+    const int BATCH = 2000;
+    double ms = 0;
+    for(int i = 0; i < n; i += BATCH) {
+        auto start = BenchClock::now();
+        for(int j = 0; j < BATCH; j++) {
+            LOG_INFO("Client[%d](%s:%d) in, userCount:%d", i + j, "127.0.0.1", 40000 + j, 12);
+        }
+        ms += ElapsedMs(start);
+        Log::Instance()->flush();
+    }
+    printf("log %-9s: %6.1f ns/line (dropped %llu)\n", name, ms * 1e6 / n,
+           static_cast<unsigned long long>(Log::Instance()->Dropped()));
+}
+
+// 一个请求路径上的日志：4条DEBUG(INFO级别下被过滤)，短连接时还有建立和关闭连接的2条INFO
+#define REQUEST_LOGS(j, info) \
+    do {\
+        if(info) { LOG_INFO("Client[%d](%s:%d) in, userCount:%d", j, "127.0.0.1", 40000 + j, 12); }\
+        LOG_DEBUG("[%s], [%s], [%s]", method.c_str(), path.c_str(), version.c_str());\
+        LOG_DEBUG("%s", path.c_str());\
+        LOG_DEBUG("file path %s", (srcDir + path).data());\
+        LOG_DEBUG("responses:%d, iovcnt:%d, to write %d", 1, 2, 1024);\
+        if(info) { LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", j, "127.0.0.1", 40000 + j, 11); }\
+    } while(0)
+
+template<typename Fn>
+static void BenchRequestLog(const char* name, int n, Fn requestLogs) {
+    Log::Instance()->init(1, "./benchlog", ".log", 1 << 14, true);
+    const int BATCH = 1000;
+    double ms = 0;
+    for(int i = 0; i < n; i += BATCH) {
+        auto start = BenchClock::now();
+        for(int j = 0; j < BATCH; j++) {
+            requestLogs(i + j);
+        }
+        ms += ElapsedMs(start);
+        Log::Instance()->flush();
+    }
+    printf("request logs at INFO, %-28s: %6.1f ns/request\n", name, ms * 1e6 / n);
+}
+
+static void BenchRequestLogs(int n) {
+    std::string method = "GET", path = "/index.html", version = "HTTP/1.1", srcDir = "/srv/resources";
+    BenchRequestLog("keep-alive (4 DEBUG)", n, [&](int j) { (void)j; REQUEST_LOGS(j, false); });
+    BenchRequestLog("short conn (4 DEBUG + 2 INFO)", n, [&](int j) { REQUEST_LOGS(j, true); });
+}
+
+// 同样的调用点按-DLOG_MIN_LEVEL=1编译：DEBUG连同参数一起去掉
+#undef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+static void BenchRequestLogsCompiledOut(int n) {
+    std::string method = "GET", path = "/index.html", version = "HTTP/1.1", srcDir = "/srv/resources";
+    BenchRequestLog("keep-alive, MIN_LEVEL=1", n, [&](int j) { (void)j; REQUEST_LOGS(j, false); });
+    BenchRequestLog("short conn, MIN_LEVEL=1", n, [&](int j) { REQUEST_LOGS(j, true); });
+}
+#undef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+
+// 请求线程上每个访问记录的耗时：填写定长记录并放进本线程的缓冲区，格式化和写文件在写线程
+static void BenchAccessLog(int n) {
+    AccessLog::Instance()->Init("./benchlog", 1, 1 << 12);
+    std::string method = "GET", path = "/index.html", version = "1.1";
+    std::string referer = "http://127.0.0.1:1316/", agent = "Mozilla/5.0 (X11; Linux x86_64) Gecko/20100101 Firefox/120.0";
+    const int BATCH = 1000;
+    double ms = 0;
+    AccessRecord rec;
+    for(int i = 0; i < n; i += BATCH) {
+        auto start = BenchClock::now();
+        for(int j = 0; j < BATCH; j++) {
+            rec.Fill(AccessLog::NowNs(), 0x0100007f, method, path, version, referer, agent);
+            rec.status = 200;
+            rec.bytes = 3073;
+            rec.sent = 3303;
+            rec.durUs = static_cast<uint32_t>((AccessLog::NowNs() - rec.timeNs) / 1000);
+            AccessLog::Instance()->Append(rec);
+        }
+        ms += ElapsedMs(start);
+        AccessLog::Instance()->Flush();
+    }
+    printf("access log   : %6.1f ns/request (dropped %llu)\n", ms * 1e6 / n,
+           static_cast<unsigned long long>(AccessLog::Instance()->Dropped()));
+}
+
+int main() {
+    BenchDispatchLegacy(1000000);
+    BenchDispatchTask(1000000);
+    BenchParseLegacy(20000);
+    BenchParseStateMachine(200000);
+    BenchHttpScan(200000);
+    {
+        HeapTimer heap;
+        BenchTimer("HeapTimer", heap, 100000, 2000000);
+        TimingWheel wheel;
+        BenchTimer("TimingWheel", wheel, 100000, 2000000);
+    }
+    BenchLog("text", false, 400000);
+    BenchLog("deferred", true, 400000);
+    BenchRequestLogs(400000);
+    BenchRequestLogsCompiledOut(400000);
+    BenchAccessLog(400000);
+}
@@ -1,6 +1,23 @@
 #include "../code/log/log.h"
+#include "../code/log/logring.h"
+#include "../code/log/accesslog.h"
 #include "../code/pool/threadpool.h"
+#include "../code/http/httpscan.h"
+#include "../code/http/httpheader.h"
+#include "../code/http/httprequest.h"
+#include "../code/http/filecache.h"
+#include "../code/http/httpresponse.h"
+#include "../code/http/httpconn.h"
+#include "../code/server/iouringpoller.h"
+#include "../code/timer/heaptimer.h"
+#include "../code/timer/timingwheel.h"
+#include <string>
+#include <functional>
 #include <features.h>
+#include <dirent.h>
+#include <zlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 30
 #include <sys/syscall.h>
@@ -30,6 +47,250 @@ void TestLog() {
     }
 }
 
+void TestLogDeferred() {
+    Log::Instance()->init(0, "./testlog3", ".log", 5000, true);
+    assert(Log::Instance()->IsDeferred());
+    std::string host = "127.0.0.1";
+    LOG_INFO("Client[%d](%s:%d) in, userCount:%d", 12, host, 8080, 3);
+    LOG_WARN("[%5s|%-4d|%.2f|%x|%.3s|%c|%llu%%]", "ab", 7, 3.14159, 255u, "abcdef", 'z', 18446744073709551615ULL);
+    LOG_ERROR("missing %d %s end", 1);
+    Log::Instance()->flush();
+    char path[64];
+    time_t now = time(nullptr);
+    struct tm t;
+    localtime_r(&now, &t);
+    snprintf(path, sizeof(path), "./testlog3/%04d_%02d_%02d.log", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    FILE* fp = fopen(path, "r");
+    assert(fp);
+    const char* expect[] = { "[info] : Client[12](127.0.0.1:8080) in, userCount:3",
+                             "[warn] : [   ab|7   |3.14|ff|abc|z|18446744073709551615%]",
+                             "[error]: missing 1  end" };
+    char line[256];
+    for(const char* e: expect) {
+        assert(fgets(line, sizeof(line), fp));
+        line[strcspn(line, "\n")] = '\0';
+        assert(strcmp(line + 27, e) == 0);     // 跳过时间戳
+    }
+    fclose(fp);
+
+    // 不延迟格式化(异步和同步)时std::string/string_view同样可以对应%s
+    std::string_view part("abcdef", 3);
+    for(int capacity: { 5000, 0 }) {
+        Log::Instance()->init(0, "./testlog7", ".log", capacity, false);
+        assert(!Log::Instance()->IsDeferred());
+        LOG_INFO("Client[%d](%s:%d) %s|%s", 12, host, 8080, part, "end");
+        Log::Instance()->flush();
+    }
+    snprintf(path, sizeof(path), "./testlog7/%04d_%02d_%02d.log", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    fp = fopen(path, "r");
+    assert(fp);
+    for(int i = 0; i < 2; i++) {
+        assert(fgets(line, sizeof(line), fp));
+        line[strcspn(line, "\n")] = '\0';
+        assert(strcmp(line + 27, "[info] : Client[12](127.0.0.1:8080) abc|end") == 0);
+    }
+    fclose(fp);
+}
+
+void TestLogRotate() {
+    const char* dir = "./testlog4";
+    DIR* d = opendir(dir);
+    for(struct dirent* e; d && (e = readdir(d));) {
+        if(e->d_name[0] != '.') { unlink((std::string(dir) + "/" + e->d_name).c_str()); }
+    }
+    if(d) { closedir(d); }
+
+    Log::Instance()->SetRotate(64 * 1024, 86400, true);
+    Log::Instance()->SetFsync(Log::FSYNC_BATCH);
+    Log::Instance()->init(0, dir, ".log", 5000);
+    for(int i = 0; i < 3000; i++) {
+        LOG_INFO("rotate %05d ==================================================================", i);
+        if(i % 500 == 499) { Log::Instance()->flush(); }
+    }
+    Log::Instance()->flush();
+    assert(Log::Instance()->WaitCompress(5000));
+
+    // 切换下来的文件都压缩了，只剩当前文件未压缩，所有行都在且不超过大小上限太多
+    int gzFiles = 0, logFiles = 0, lines = 0;
+    char line[256];
+    d = opendir(dir);
+    for(struct dirent* e; (e = readdir(d));) {
+        std::string name = e->d_name;
+        if(name[0] == '.') { continue; }
+        std::string path = std::string(dir) + "/" + name;
+        bool gz = name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0;
+        gz ? gzFiles++ : logFiles++;
+        gzFile f = gzopen(path.c_str(), "rb");
+        assert(f);
+        int bytes = 0;
+        while(gzgets(f, line, sizeof(line))) {
+            lines++;
+            bytes += strlen(line);
+        }
+        gzclose(f);
+        assert(bytes <= 64 * 1024 + 500 * 128);
+    }
+    closedir(d);
+    assert(gzFiles >= 3 && logFiles == 1 && lines == 3000);
+    Log::Instance()->SetRotate(128 * 1024 * 1024, 86400, true);
+    Log::Instance()->SetFsync(Log::FSYNC_ROTATE);
+}
+
+void TestLogLimiter() {
+    LogLimiter rate(__FILE__, __LINE__, 1, 10, 5, 1);     // 每秒10条，突发5条
+    uint64_t allowed = 0;
+    for(int i = 0; i < 100; i++) { allowed += rate.Allow(); }
+    assert(allowed == 5 && rate.Suppressed() == 95);
+    usleep(220000);     // 补回约2条
+    allowed = 0;
+    for(int i = 0; i < 100; i++) { allowed += rate.Allow(); }
+    assert(allowed >= 1 && allowed <= 3);
+    assert(rate.TakeSuppressed() == 95 + 100 - allowed && rate.Suppressed() == 0);
+
+    LogLimiter sample(__FILE__, __LINE__, 1, 0, 0, 4);    // 每4条取1条
+    allowed = 0;
+    for(int i = 0; i < 100; i++) { allowed += sample.Allow(); }
+    assert(allowed == 25 && sample.Suppressed() == 75);
+}
+
+void TestLogRing() {
+    LogRing ring(4096);
+    assert(ring.Reserve(4096) == nullptr);     // 超过一半容量的记录直接拒绝
+    const int N = 200000;
+    std::thread producer([&ring]() {
+        for(int i = 0; i < N;) {
+            char* p = ring.Reserve(64);
+            if(!p) { continue; }        // 满了就重试，保证顺序完整
+            int len = snprintf(p, 64, "%d", i);
+            ring.Commit(LogRing::TEXT, len);
+            i++;
+        }
+    });
+    int expect = 0;
+    while(expect < N) {
+        size_t pos;
+        uint32_t tag, len;
+        const char* data;
+        if(!ring.Front(pos, tag, data, len)) { continue; }
+        if(tag == LogRing::TEXT) {
+            assert(std::string(data, len) == std::to_string(expect));
+            expect++;
+        }
+        assert(ring.Pop(pos, len));
+    }
+    producer.join();
+    assert(ring.Used() == 0);
+
+    // 写满后丢弃最早的记录，剩下的是连续的最新记录
+    LogRing small(4096);
+    int next = 0;
+    uint64_t lines = 0;
+    for(; next < 200; next++) {
+        char* p = small.Reserve(64);
+        if(!p) {
+            small.DropOldest(64, lines);
+            p = small.Reserve(64);
+        }
+        assert(p);
+        small.Commit(LogRing::TEXT, snprintf(p, 64, "%d", next));
+    }
+    size_t pos;
+    uint32_t tag, len;
+    const char* data;
+    int first = -1, last = -1, count = 0;
+    while(small.Front(pos, tag, data, len)) {
+        if(tag == LogRing::TEXT) {
+            int v = atoi(std::string(data, len).c_str());
+            assert(first < 0 || v == last + 1);
+            if(first < 0) { first = v; }
+            last = v;
+            count++;
+        }
+        assert(small.Pop(pos, len));
+    }
+    assert(last == 199 && first == static_cast<int>(lines) && count + lines == 200);
+}
+
+// 缓冲区很小时一次写入大量日志，三种溢出策略下写出和丢弃的行数都要对得上
+void TestLogOverflow() {
+    Log* log = Log::Instance();
+    log->init(0, "./testlog5", ".log", 64);     // 之后新建的线程缓冲区只有8KB
+    const Log::OVERFLOW_POLICY policies[] = { Log::DROP_NEWEST, Log::DROP_OLDEST, Log::BLOCK };
+    for(Log::OVERFLOW_POLICY policy: policies) {
+        log->SetOverflow(policy, 1000);
+        log->flush();
+        Log::Stats before = log->GetStats();
+        std::thread t([]() {
+            for(int i = 0; i < 5000; i++) {
+                LOG_INFO("overflow %d ========================================", i);
+            }
+        });
+        t.join();
+        log->flush();
+        Log::Stats after = log->GetStats();
+        uint64_t dropped = after.droppedLines - before.droppedLines;
+        assert(after.lines - before.lines + dropped >= 5000);
+        assert((dropped == 0) == (after.droppedBytes == before.droppedBytes));
+        if(policy == Log::BLOCK) {
+            assert(dropped == 0);
+        }
+    }
+    log->SetOverflow(Log::DROP_NEWEST);
+
+    // 容量很小时线程缓冲区也至少放得下一行最长的日志，不会每行都被丢弃
+    log->init(0, "./testlog5", ".log", 1);
+    log->flush();
+    Log::Stats before = log->GetStats();
+    std::thread t([]() { LOG_INFO("small queue %d", 1); });
+    t.join();
+    log->flush();
+    Log::Stats after = log->GetStats();
+    assert(after.lines == before.lines + 1 && after.droppedLines == before.droppedLines);
+}
+
+// 抽样、错误请求总是记录，以及一行的格式(引号转义、没有正文时为"-")
+void TestAccessLog() {
+    AccessLog* log = AccessLog::Instance();
+    log->Init("./testlog6", 2);
+    int sampled = 0;
+    for(int i = 0; i < 10; i++) { sampled += log->Sample(200); }
+    assert(sampled == 5);
+    assert(log->Sample(404) && log->Sample(500));
+    AccessRecord rec;
+    rec.Fill(AccessLog::NowNs(), htonl(0x7f000001), "GET", "/a \"b\".html", "1.1", "", "curl/8.0");
+    rec.status = 200;
+    rec.bytes = 3073;
+    rec.sent = 3303;
+    rec.durUs = 125;
+    log->Append(rec);
+    rec.Fill(AccessLog::NowNs(), htonl(0x7f000001), "GET", "/index.html", "1.0", "http://127.0.0.1/", "");
+    rec.status = 304;
+    rec.bytes = 0;
+    rec.sent = 181;
+    rec.durUs = 7;
+    log->Append(rec);
+    log->Flush();
+
+    char path[64];
+    time_t now = time(nullptr);
+    struct tm t;
+    localtime_r(&now, &t);
+    snprintf(path, sizeof(path), "./testlog6/access_%04d_%02d_%02d.log", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    FILE* fp = fopen(path, "r");
+    assert(fp);
+    const char* expect[] = { "\"GET /a \\x22b\\x22.html HTTP/1.1\" 200 3073 \"-\" \"curl/8.0\" 125 3303",
+                             "\"GET /index.html HTTP/1.0\" 304 - \"http://127.0.0.1/\" \"-\" 7 181" };
+    char line[512];
+    for(const char* e: expect) {
+        assert(fgets(line, sizeof(line), fp));
+        line[strcspn(line, "\n")] = '\0';
+        assert(strncmp(line, "127.0.0.1 - - [", 15) == 0);
+        assert(strcmp(strstr(line, "] ") + 2, e) == 0);     // 跳过时间
+    }
+    fclose(fp);
+    log->Init("./testlog6", 0);
+}
+
 void ThreadLogTask(int i, int cnt) {
     for(int j = 0; j < 10000; j++ ){
         LOG_BASE(i,"PID:[%04d]======= %05d ========= ", gettid(), cnt++);
@@ -45,7 +306,621 @@ void TestThreadPool() {
     getchar();
 }
 
+// 外部线程提交的任务再在工作线程里提交子任务，子任务走本地队列并可被其他线程窃取
+void TestThreadPoolSteal() {
+    std::atomic<int> outer(0), inner(0);
+    const int N = 100000;
+    ThreadPool threadpool(6);
+    for(int i = 0; i < N; i++) {
+        threadpool.AddTask([&]() {
+            outer++;
+            threadpool.AddTask([&]() { inner++; });
+        });
+    }
+    while(outer + inner < 2 * N) {
+        std::this_thread::yield();
+    }
+    assert(outer == N && inner == N);
+}
+
+// 没有执行就被析构或覆盖的Task也要释放堆上的可调用对象
+void TestTask() {
+    std::shared_ptr<int> ref = std::make_shared<int>(0);
+    auto big = [ref]() { (*ref)++; };      // 捕获shared_ptr，不可平凡复制，放在堆上
+    static_assert(!Task::IsInline<decltype(big)>(), "expect heap task");
+    {
+        Task task(big);
+        assert(ref.use_count() == 3);
+    }
+    assert(ref.use_count() == 2);
+    Task task(big);
+    task = Task(big);                       // 覆盖时释放原来的
+    assert(ref.use_count() == 3);
+    Task moved(std::move(task));
+    assert(!task && ref.use_count() == 3);
+    moved();                                // 执行后释放
+    assert(!moved && ref.use_count() == 2 && *ref == 1);
+    Task adopted(Task(big).Release());      // Release交出的由接管方释放
+    assert(ref.use_count() == 3);
+    adopted = Task();
+    assert(ref.use_count() == 2);
+}
+
+// 各个SIMD实现的结果必须与标量实现一致，包括分块边界和末尾不足一块的情况
+void TestHttpScan() {
+    const char alphabet[] = "ab:\r\n \t\x01\x7f\xc3";
+    srand(1);
+    for(int round = 0; round < 2000; round++) {
+        std::string s;
+        int len = rand() % 100;
+        for(int i = 0; i < len; i++) {
+            // 大部分是普通字符，偶尔出现分隔符和非法字符
+            s += (rand() % 8) ? 'a' + rand() % 26 : alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        const char* b = s.data();
+        const char* e = b + s.size();
+        HttpScan::Use(HttpScan::SCALAR);
+        const char* crlf = HttpScan::FindCRLF(b, e);
+        const char* colon = HttpScan::FindChar(b, e, ':');
+        const char* invalid = HttpScan::FindInvalid(b, e);
+        for(HttpScan::ISA isa: {HttpScan::SSE42, HttpScan::AVX2}) {
+            if(!HttpScan::Use(isa)) { continue; }
+            assert(HttpScan::FindCRLF(b, e) == crlf);
+            assert(HttpScan::FindChar(b, e, ':') == colon);
+            assert(HttpScan::FindInvalid(b, e) == invalid);
+        }
+    }
+}
+
+// 已知头部不区分大小写都能查到，其他名字(包括长度相同或只差一个字符的)返回UNKNOWN
+void TestHttpHeader() {
+    static_assert(HttpHeader::Lookup("content-length") == HttpHeader::CONTENT_LENGTH, "compile-time lookup");
+    for(int i = 0; i < HttpHeader::COUNT; i++) {
+        HttpHeader::ID id = static_cast<HttpHeader::ID>(i);
+        std::string name(HttpHeader::Name(id));
+        assert(HttpHeader::Lookup(name) == id);
+        for(auto& ch: name) { ch = toupper(ch); }
+        assert(HttpHeader::Lookup(name) == id);
+        name.back() = '_';
+        assert(HttpHeader::Lookup(name) == HttpHeader::UNKNOWN);
+    }
+    assert(HttpHeader::Lookup("X-Forwarded-For") == HttpHeader::UNKNOWN);
+    assert(HttpHeader::Lookup("") == HttpHeader::UNKNOWN);
+}
+
+// 分段到达时保留解析进度：任意字节处切开、CRLF中间切开、请求体晚于头部到达，以及各种非法请求
+void TestHttpRequestParse() {
+    const std::string req = "POST /echo HTTP/1.1\r\nHost: localhost\r\n"
+                            "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: 8\r\n\r\na=1&b=xy";
+    for(size_t cut = 0; cut <= req.size(); cut++) {
+        HttpRequest request;
+        Buffer buff;
+        buff.Append(req.data(), cut);
+        HttpRequest::PARSE_RESULT ret = request.parse(buff);
+        assert(ret == (cut == req.size() ? HttpRequest::COMPLETE : HttpRequest::NEED_MORE));
+        buff.Append(req.data() + cut, req.size() - cut);
+        assert(request.parse(buff) == HttpRequest::COMPLETE && buff.ReadableBytes() == 0);
+        assert(request.method() == "POST" && request.path() == "/echo" && request.version() == "1.1");
+        assert(request.GetHeader(HttpHeader::HOST) == "localhost");
+        assert(request.GetPost("a") == "1" && request.GetPost("b") == "xy");
+    }
+    // 逐字节到达
+    {
+        HttpRequest request;
+        Buffer buff;
+        for(size_t i = 0; i < req.size(); i++) {
+            buff.Append(req.data() + i, 1);
+            assert(request.parse(buff) == (i + 1 == req.size() ? HttpRequest::COMPLETE : HttpRequest::NEED_MORE));
+        }
+        assert(request.GetPost("b") == "xy");
+    }
+    // '\r'和'\n'分在两次读取里，后面跟着下一个请求的开头
+    {
+        HttpRequest request;
+        Buffer buff;
+        const char* parts[] = { "GET / HTTP/1.1\r", "\nConnection: keep-alive\r", "\n\r", "\nGET /next" };
+        HttpRequest::PARSE_RESULT rets[] = { HttpRequest::NEED_MORE, HttpRequest::NEED_MORE,
+                                             HttpRequest::NEED_MORE, HttpRequest::COMPLETE };
+        for(int i = 0; i < 4; i++) {
+            buff.Append(parts[i], strlen(parts[i]));
+            assert(request.parse(buff) == rets[i]);
+        }
+        assert(request.path() == "/index.html" && request.IsKeepAlive());
+        assert(std::string(buff.Peek(), buff.ReadableBytes()) == "GET /next");     // 留给下一个请求
+    }
+    // 头部收齐后请求体才到
+    {
+        HttpRequest request;
+        Buffer buff;
+        size_t head = req.size() - 8;
+        buff.Append(req.data(), head);
+        assert(request.parse(buff) == HttpRequest::NEED_MORE && buff.ReadableBytes() == 0);
+        buff.Append(req.data() + head, 4);
+        assert(request.parse(buff) == HttpRequest::NEED_MORE && buff.ReadableBytes() == 4);
+        buff.Append(req.data() + head + 4, 4);
+        assert(request.parse(buff) == HttpRequest::COMPLETE && request.GetPost("b") == "xy");
+    }
+    // 非法请求
+    {
+        HttpRequest request;
+        Buffer buff;
+        std::string longLine = "GET /" + std::string(HttpRequest::MAX_LINE_LEN, 'a');
+        buff.Append(longLine.data(), HttpRequest::MAX_LINE_LEN);
+        assert(request.parse(buff) == HttpRequest::NEED_MORE);
+        buff.Append(longLine.data() + HttpRequest::MAX_LINE_LEN, longLine.size() - HttpRequest::MAX_LINE_LEN);
+        assert(request.parse(buff) == HttpRequest::BAD_REQUEST);
+    }
+    // 一次读到的完整超长行，以及单行都不超长但总量或个数超限的头部
+    {
+        std::string longHeader = "GET / HTTP/1.1\r\nX-Long: " + std::string(HttpRequest::MAX_LINE_LEN, 'a') + "\r\n\r\n";
+        std::string manyBytes = "GET / HTTP/1.1\r\n";
+        for(int i = 0; i < 10; i++) { manyBytes += "Cookie: " + std::string(8000, 'c') + "\r\n"; }
+        std::string manyHeaders = "GET / HTTP/1.1\r\n";
+        for(size_t i = 0; i <= HttpRequest::MAX_HEADER_CNT; i++) { manyHeaders += "X-A: 1\r\n"; }
+        for(const std::string* s: { &longHeader, &manyBytes, &manyHeaders }) {
+            HttpRequest request;
+            Buffer buff;
+            buff.Append(s->data(), s->size());
+            assert(request.parse(buff) == HttpRequest::BAD_REQUEST);
+        }
+        manyHeaders.resize(manyHeaders.size() - strlen("X-A: 1\r\n"));
+        manyHeaders += "\r\n";
+        HttpRequest request;
+        Buffer buff;
+        buff.Append(manyHeaders.data(), manyHeaders.size());
+        assert(request.parse(buff) == HttpRequest::COMPLETE);     // 正好MAX_HEADER_CNT个
+    }
+    const char* bad[] = {
+        "GET /\r\n\r\n",
+        "GET / HTTP/1.1\r\nNoColon\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 12x\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: \r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 99999999999\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+    };
+    for(const char* s: bad) {
+        HttpRequest request;
+        Buffer buff;
+        buff.Append(s, strlen(s));
+        assert(request.parse(buff) == HttpRequest::BAD_REQUEST);
+    }
+}
+
+// 命中、文件修改后重新加载、超出预算时淘汰(被淘汰的条目仍可使用)
+void TestFileCache() {
+    FileCache* cache = FileCache::Instance();
+    cache->Init(16 * 4096, 0);      // 每个分片4KB，单个文件最大1KB；校验间隔为0，每次都stat
+    const std::string dir = "./testcache";
+    mkdir(dir.c_str(), 0755);
+    // 清掉上一次运行留下的文件(如c.css.gz)，否则"兄弟文件不存在"的检查会失败
+    DIR* d = opendir(dir.c_str());
+    for(struct dirent* e; d && (e = readdir(d));) {
+        if(e->d_name[0] != '.') { unlink((dir + "/" + e->d_name).c_str()); }
+    }
+    if(d) { closedir(d); }
+    auto writeFile = [](const std::string& path, const std::string& content) {
+        FILE* fp = fopen(path.c_str(), "w");
+        fputs(content.c_str(), fp);
+        fclose(fp);
+        chmod(path.c_str(), 0644);
+    };
+    writeFile(dir + "/a.html", "hello");
+    auto a = cache->Get(dir + "/a.html", "text/html");
+    assert(a && a->data == "hello");
+    assert(a->headers == "Content-type: text/html\r\nContent-length: 5\r\n\r\n");
+    assert(cache->Get(dir + "/a.html", "text/html") == a);
+    assert(cache->GetStats().hits == 1);
+
+    usleep(10000);
+    writeFile(dir + "/a.html", "hello world");
+    auto a2 = cache->Get(dir + "/a.html", "text/html");
+    assert(a2 && a2 != a && a2->data == "hello world" && a->data == "hello");
+    assert(a2->etag != a->etag && a2->etag.front() == '"' && a2->lastModified.size() == 29);  // IMF-fixdate定长
+    assert(cache->GetStats().invalidations == 1);
+
+    writeFile(dir + "/big.html", std::string(2048, 'x'));
+    // 超过单个文件上限：只缓存元数据，之后只stat校验，不再open/fstat
+    auto big = cache->Get(dir + "/big.html", "text/html");
+    assert(big && big->large && !big->exists && big->data.empty() && big->size == 2048);
+    assert(cache->Get(dir + "/big.html", "text/html", FileCache::GZIP, true) == nullptr);
+    uint64_t bigMisses = cache->GetStats().misses;
+    assert(cache->Get(dir + "/big.html", "text/html") == big);
+    assert(cache->Get(dir + "/big.html", "text/html", FileCache::GZIP, true) == nullptr);
+    assert(cache->GetStats().misses == bigMisses);
+    {
+        HttpResponse response;
+        Buffer buff;
+        std::string bigPath = "/big.html";
+        response.Init(dir, bigPath, false, 200);
+        response.MakeResponse(buff);        // 用缓存的元数据，不再stat，按未缓存的文件发送
+        assert(response.Code() == 200 && !response.CachedFile() && response.FileLen() == 2048);
+        assert(response.File() && response.File()[2047] == 'x');
+        response.UnmapFile();
+    }
+    assert(cache->Get(dir + "/missing.html", "text/html") == nullptr);
+
+    for(int i = 0; i < 200; i++) {
+        writeFile(dir + "/f" + std::to_string(i), std::string(1000, 'a' + i % 26));
+        assert(cache->Get(dir + "/f" + std::to_string(i), "text/plain"));
+    }
+    FileCache::Stats stats = cache->GetStats();
+    assert(stats.evictions > 0 && stats.bytes <= 16 * 4096);
+    assert(a2->data == "hello world");
+
+    // gzip变体：压缩结果能还原，头部带Content-encoding和Vary
+    const std::string text(1000, 'z');
+    writeFile(dir + "/c.css", text);
+    auto gz = cache->Get(dir + "/c.css", "text/css", FileCache::GZIP, true);
+    assert(gz && gz->data.size() < text.size());
+    assert(gz->headers == "Content-type: text/css\r\nContent-encoding: gzip\r\nVary: Accept-Encoding\r\n"
+                          "Content-length: " + std::to_string(gz->data.size()) + "\r\n\r\n");
+    std::string plain(text.size() + 1, '\0');
+    z_stream zs = {};
+    inflateInit2(&zs, 15 + 16);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(gz->data.data()));
+    zs.avail_in = gz->data.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&plain[0]);
+    zs.avail_out = plain.size();
+    assert(inflate(&zs, Z_FINISH) == Z_STREAM_END && zs.total_out == text.size());
+    inflateEnd(&zs);
+    plain.resize(zs.total_out);
+    assert(plain == text);
+    assert(cache->Get(dir + "/c.css", "text/css", FileCache::GZIP, true) == gz);
+    assert(cache->Get(dir + "/c.css", "text/css") != gz);    // 原始内容是另一个变体
+    assert(gz->etag != cache->Get(dir + "/c.css", "text/css")->etag);
+    assert(cache->Get(dir + "/a.html", "text/html", FileCache::GZIP, true) == nullptr);   // 太小不压缩
+
+    // 不存在的兄弟文件缓存空条目，创建后重新校验能发现
+    uint64_t misses = cache->GetStats().misses;
+    assert(cache->Get(dir + "/c.css.gz", "text/css", FileCache::GZIP_FILE, true) == nullptr);
+    assert(cache->Get(dir + "/c.css.gz", "text/css", FileCache::GZIP_FILE, true) == nullptr);
+    assert(cache->GetStats().misses == misses + 1);
+    writeFile(dir + "/c.css.gz", "precompressed");
+    auto pre = cache->Get(dir + "/c.css.gz", "text/css", FileCache::GZIP_FILE, true);
+    assert(pre && pre->data == "precompressed");
+
+    assert(HttpResponse::ParseAcceptEncoding("gzip, deflate, br") == (HttpResponse::ENC_GZIP | HttpResponse::ENC_BR));
+    assert(HttpResponse::ParseAcceptEncoding("GZIP;q=0.5, br;q=0") == HttpResponse::ENC_GZIP);
+    assert(HttpResponse::ParseAcceptEncoding("br;q=0.000, *") == HttpResponse::ENC_GZIP);
+    assert(HttpResponse::ParseAcceptEncoding("identity") == 0);
+    assert(HttpResponse::ParseAcceptEncoding("*;q=0") == 0);
+    cache->Init(0);
+    assert(cache->Get(dir + "/a.html", "text/html") == nullptr);     // 预算为0时关闭
+}
+
+void TestHttpResponseRange() {
+    std::string dir = "./testcache", path = "/r.txt";
+    FILE* fp = fopen((dir + path).c_str(), "w");
+    fputs(std::string(1000, 'r').c_str(), fp);
+    fclose(fp);
+    chmod((dir + path).c_str(), 0644);
+
+    HttpResponse response;
+    Buffer buff;
+    response.Init(dir, path, false, 200);
+    response.SetRange("bytes=0-9, 5-19, -10", "");
+    response.MakeResponse(buff);
+    assert(response.Code() == 206 && response.Slices().size() == 2);   // 前两个范围合并
+    assert(response.Slices()[0].offset == 0 && response.Slices()[0].len == 20);
+    assert(response.Slices()[1].offset == 990 && response.Slices()[1].len == 10);
+
+    response.Init(dir, path, false, 200);
+    response.SetRange("bytes=1000-", "");
+    response.MakeResponse(buff);
+    assert(response.Code() == 416);
+
+    response.Init(dir, path, false, 200);
+    response.SetRange("bytes=0-9", "\"stale\"");      // If-Range不一致时发送整个文件
+    response.MakeResponse(buff);
+    assert(response.Code() == 200 && response.Slices().empty());
+}
+
+// 生成一个GET响应，返回状态码，头部写进head
+static int ConditionalGet(const std::string& dir, const char* ifNoneMatch, const char* ifModifiedSince,
+                          std::string& head) {
+    std::string path = "/c.txt";
+    HttpResponse response;
+    Buffer buff;
+    response.Init(dir, path, false, 200);
+    response.SetConditional(ifNoneMatch, ifModifiedSince);
+    response.MakeResponse(buff);
+    head = buff.RetrieveAllToStr();
+    if(response.Code() == 304) {
+        // 没有消息体，也不打开文件
+        assert(head.size() >= 4 && head.compare(head.size() - 4, 4, "\r\n\r\n") == 0);
+        assert(head.find("Content-length") == std::string::npos);
+        assert(!response.File() && response.FileFd() < 0);
+        assert(response.BodyLen() == 0);
+    } else {
+        assert(response.BodyLen() == strlen("conditional"));    // 访问日志记录的正文字节数不含头部
+    }
+    response.UnmapFile();
+    return response.Code();
+}
+
+// If-None-Match(强、弱、列表、*)和If-Modified-Since(等于、早于、晚于修改时间)，前者优先；缓存开关两条路径结果一致
+void TestHttpConditional() {
+    std::string dir = "./testcache";
+    FILE* fp = fopen((dir + "/c.txt").c_str(), "w");
+    fputs("conditional", fp);
+    fclose(fp);
+    chmod((dir + "/c.txt").c_str(), 0644);
+    struct timeval times[2] = { { 1000000000, 0 }, { 1000000000, 0 } };     // Sun, 09 Sep 2001 01:46:40 GMT
+    utimes((dir + "/c.txt").c_str(), times);
+    const char* same = "Sun, 09 Sep 2001 01:46:40 GMT";
+    const char* older = "Sat, 08 Sep 2001 01:46:40 GMT";
+    const char* newer = "Mon, 10 Sep 2001 01:46:40 GMT";
+
+    for(size_t budget: { (size_t)0, (size_t)1 << 20 }) {
+        FileCache::Instance()->Init(budget);
+        std::string head;
+        assert(ConditionalGet(dir, "", "", head) == 200);
+        size_t pos = head.find("ETag: ") + 6;
+        std::string etag = head.substr(pos, head.find("\r\n", pos) - pos);
+        assert(etag.size() > 2 && etag.front() == '"' && head.find(std::string("Last-Modified: ") + same) != std::string::npos);
+
+        assert(ConditionalGet(dir, etag.c_str(), "", head) == 304);
+        assert(head.find("ETag: " + etag) != std::string::npos);
+        assert(ConditionalGet(dir, ("W/" + etag).c_str(), "", head) == 304);
+        assert(ConditionalGet(dir, ("\"x\", " + etag + " ,\"y\"").c_str(), "", head) == 304);
+        assert(ConditionalGet(dir, "\"x\", \"y\"", "", head) == 200);
+        assert(ConditionalGet(dir, "*", "", head) == 304);
+
+        assert(ConditionalGet(dir, "", same, head) == 304);
+        assert(ConditionalGet(dir, "", newer, head) == 304);
+        assert(ConditionalGet(dir, "", older, head) == 200);
+        assert(ConditionalGet(dir, "", "not a date", head) == 200);
+
+        assert(ConditionalGet(dir, "\"x\"", same, head) == 200);        // If-None-Match优先
+        assert(ConditionalGet(dir, etag.c_str(), older, head) == 304);
+    }
+    FileCache::Instance()->Init(0);
+
+    // Cache-Control按类型设置
+    std::string head;
+    int age = HttpResponse::MaxAge("text/plain");
+    HttpResponse::SetMaxAge("text/plain", 60);
+    ConditionalGet(dir, "", "", head);
+    assert(head.find("Cache-Control: max-age=60\r\n") != std::string::npos);
+    HttpResponse::SetMaxAge("text/plain", 0);
+    ConditionalGet(dir, "", "", head);
+    assert(head.find("Cache-Control: no-cache\r\n") != std::string::npos);
+    HttpResponse::SetMaxAge("text/plain", -1);
+    ConditionalGet(dir, "", "", head);
+    assert(head.find("Cache-Control") == std::string::npos);
+    HttpResponse::SetMaxAge("text/plain", age);
+}
+
+// 把排队的响应全部发出，返回对端收到的字节
+static std::string FlushConn(HttpConn& conn, int peer) {
+    int err = 0;
+    while(conn.ToWriteBytes() > 0) {
+        assert(conn.write(&err) > 0);
+    }
+    std::string out;
+    char buf[4096];
+    ssize_t n;
+    while((n = recv(peer, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        out.append(buf, n);
+    }
+    return out;
+}
+
+// 一次读到多个流水线请求和半个请求：响应按顺序合并发送，头部不和前面的sendfile块合并，半个请求留到下次
+void TestHttpConnPipeline() {
+    mkdir("./testconn", 0777);
+    std::string a(10, 'a'), b(100, 'b');
+    FILE* fp = fopen("./testconn/a.txt", "w");
+    fputs(a.c_str(), fp);
+    fclose(fp);
+    fp = fopen("./testconn/b.txt", "w");
+    fputs(b.c_str(), fp);
+    fclose(fp);
+    chmod("./testconn/a.txt", 0644);
+    chmod("./testconn/b.txt", 0644);
+    size_t threshold = HttpResponse::sendfileThreshold;
+    HttpResponse::sendfileThreshold = 64;       // b.txt走sendfile，a.txt走mmap
+    HttpConn::srcDir = "./testconn";
+
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    sockaddr_in addr = {};
+    HttpConn conn;
+    conn.init(sv[0], addr);
+    const std::string keep = " HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    // b(sendfile)、404(头部紧跟在文件块后)、a(头部与404合并)，最后半个请求
+    std::string reqs = "GET /b.txt" + keep + "GET /none.txt" + keep + "GET /a.txt" + keep + "GET /a.t";
+    assert(::write(sv[1], reqs.data(), reqs.size()) == (ssize_t)reqs.size());
+    int err = 0;
+    assert(conn.read(&err) == (ssize_t)reqs.size());
+    assert(conn.process());
+    size_t toWrite = conn.ToWriteBytes();
+    std::string out = FlushConn(conn, sv[1]);
+    assert(out.size() == toWrite);
+    size_t posB = out.find("\r\n\r\n" + b), pos404 = out.find(" 404 "), posA = out.find("\r\n\r\n" + a);
+    assert(out.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    assert(posB != std::string::npos && pos404 != std::string::npos && posA != std::string::npos);
+    assert(posB < pos404 && pos404 < posA && posA + 4 + a.size() == out.size());
+
+    assert(!conn.process());        // 只剩半个请求
+    std::string rest = "xt" + keep;
+    assert(::write(sv[1], rest.data(), rest.size()) == (ssize_t)rest.size());
+    assert(conn.read(&err) == (ssize_t)rest.size());
+    assert(conn.process());
+    out = FlushConn(conn, sv[1]);
+    assert(out.compare(0, 15, "HTTP/1.1 200 OK") == 0 && out.size() - out.find("\r\n\r\n") - 4 == a.size());
+
+    conn.Close();
+    close(sv[1]);
+    HttpResponse::sendfileThreshold = threshold;
+}
+
+// 发送途中文件被截断时sendfile返回0，要报告错误让连接关闭，不能当成EAGAIN一直等写事件
+void TestHttpConnTruncate() {
+    const size_t size = 4 << 20;
+    FILE* fp = fopen("./testconn/big.txt", "w");
+    fputs(std::string(size, 'z').c_str(), fp);
+    fclose(fp);
+    chmod("./testconn/big.txt", 0644);
+    HttpConn::srcDir = "./testconn";
+
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    sockaddr_in addr = {};
+    HttpConn conn;
+    conn.init(sv[0], addr);
+    std::string req = "GET /big.txt HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    assert(::write(sv[1], req.data(), req.size()) == (ssize_t)req.size());
+    int err = 0;
+    assert(conn.read(&err) > 0 && conn.process());
+    assert(conn.ToWriteBytes() > (int)size);
+    assert(conn.write(&err) < 0 && err == EAGAIN);     // 对端不读，发送缓冲区满
+    assert(conn.ToWriteBytes() > 0);
+
+    assert(truncate("./testconn/big.txt", 0) == 0);
+    char buf[65536];
+    while(recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT) > 0) {}
+    err = 0;
+    assert(conn.write(&err) < 0 && err == EIO);
+    assert(conn.ToWriteBytes() > 0);
+    conn.Close();
+    close(sv[1]);
+}
+
+// io_uring的完成式I/O：multishot accept带回新连接，recv的数据和send的字节数随事件带回，
+// 删除时取消未完成的recv，之后的完成事件不再报告
+void TestIoUringPoller() {
+    IoUringPoller poller;
+    if(!poller.IsOpen()) {
+        return;     // 内核不支持时服务器回退到epoll
+    }
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    assert(bind(listenFd, (sockaddr*)&addr, sizeof(addr)) == 0 && listen(listenFd, 8) == 0);
+    assert(getsockname(listenFd, (sockaddr*)&addr, &len) == 0);
+    assert(poller.AddAccept(listenFd, EPOLLRDHUP));
+
+    int peer = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(peer, (sockaddr*)&addr, sizeof(addr)) == 0);
+    assert(poller.Wait(1000) == 1 && poller.GetEventFd(0) == listenFd);
+    int fd = poller.GetEventResult(0);
+    assert(fd > 0);
+
+    HttpConn::srcDir = "./testconn";
+    HttpConn conn;
+    conn.init(fd, addr);
+    const uint32_t tag = 7;
+    assert(poller.AddRecv(fd, EPOLLONESHOT | EPOLLRDHUP, tag));
+    std::string req = "GET /a.txt HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    assert(::write(peer, req.data(), req.size()) == (ssize_t)req.size());
+    assert(poller.Wait(1000) == 1);
+    assert(poller.GetEventFd(0) == fd && poller.GetEventTag(0) == tag && (poller.GetEvents(0) & EPOLLIN));
+    assert(poller.GetEventResult(0) == (int)req.size());
+    conn.ReadDone(poller.GetEventData(0), poller.GetEventResult(0));
+    assert(conn.process());
+
+    // a.txt不大，头部和内容都在内存里，整个响应交给sendmsg
+    const struct iovec* iov = nullptr;
+    int iovCnt = conn.WriteIov(&iov);
+    assert(iovCnt > 0);
+    size_t toWrite = conn.ToWriteBytes();
+    assert(poller.ModSend(fd, EPOLLONESHOT | EPOLLRDHUP, tag, iov, iovCnt));
+    assert(poller.Wait(1000) == 1 && (poller.GetEvents(0) & EPOLLOUT));
+    assert(poller.GetEventResult(0) == (int)toWrite);
+    conn.WriteDone(poller.GetEventResult(0));
+    assert(conn.ToWriteBytes() == 0);
+    std::string out(toWrite, '\0');
+    assert(recv(peer, &out[0], toWrite, MSG_WAITALL) == (ssize_t)toWrite);
+    assert(out.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+
+    // 取消等待中的recv，随后到达的数据不再报告
+    assert(poller.ModRecv(fd, EPOLLONESHOT | EPOLLRDHUP, tag));
+    assert(poller.Wait(0) == 0);
+    assert(poller.DelFd(fd));
+    assert(!poller.DelFd(fd));
+    assert(::write(peer, req.data(), req.size()) == (ssize_t)req.size());
+    assert(poller.Wait(100) == 0);
+
+    // 对端关闭作为EPOLLRDHUP报告
+    assert(poller.AddRecv(fd, EPOLLONESHOT | EPOLLRDHUP, tag + 1));
+    close(peer);
+    assert(poller.Wait(1000) == 1 && poller.GetEventTag(0) == tag + 1);
+    assert(poller.GetEventResult(0) == (int)req.size());
+    assert(poller.ModRecv(fd, EPOLLONESHOT | EPOLLRDHUP, tag + 1));
+    assert(poller.Wait(1000) == 1 && (poller.GetEvents(0) & EPOLLRDHUP));
+    assert(poller.DelFd(fd));
+    conn.Close();
+    close(listenFd);
+}
+
+void TestHeapTimer() {
+    // 下沉只走一层时弹出顺序会乱；记录添加时算出的到期时间，允许1ms的误差
+    HeapTimer timer;
+    std::vector<TimeStamp> order;
+    srand(2);
+    for(int i = 0; i < 200; i++) {
+        TimeStamp expires = Clock::now() + MS(rand() % 40);
+        timer.add(i, std::chrono::duration_cast<MS>(expires - Clock::now()).count(),
+                  [&order, expires]() { order.push_back(expires); });
+    }
+    usleep(50000);
+    timer.tick();
+    assert(order.size() == 200);
+    for(size_t i = 1; i < order.size(); i++) {
+        assert(order[i] + MS(1) >= order[i - 1]);
+    }
+}
+
+void TestTimingWheel() {
+    TimingWheel wheel(10, 8);      // 10ms一格，一圈80ms
+    std::vector<int> fired;
+    for(int i = 0; i < 4; i++) {
+        wheel.add(i, 30, [&fired, i]() { fired.push_back(i); });
+    }
+    wheel.add(4, 200, [&fired]() { fired.push_back(4); });     // 超过一圈
+    wheel.add(9, 30, [&fired]() { fired.push_back(9); });
+    wheel.cancel(9);
+    assert(wheel.size() == 5);
+    usleep(20000);
+    wheel.adjust(1, 60);    // 惰性延后
+    usleep(30000);
+    wheel.tick();
+    std::sort(fired.begin(), fired.end());
+    assert((fired == std::vector<int>{ 0, 2, 3 }));
+    usleep(50000);
+    wheel.tick();
+    assert(fired.size() == 4 && fired.back() == 1);
+    assert(wheel.GetNextTick() > 0 && wheel.size() == 1);
+    usleep(120000);
+    wheel.tick();
+    assert(fired.size() == 5 && fired.back() == 4 && wheel.GetNextTick() == -1);
+}
+
 int main() {
     TestLog();
+    TestLogRing();
+    TestLogDeferred();
+    TestLogRotate();
+    TestLogLimiter();
+    TestLogOverflow();
+    TestAccessLog();
     //TestThreadPool();
+    TestThreadPoolSteal();
+    TestTask();
+    TestHttpScan();
+    TestHttpHeader();
+    TestHttpRequestParse();
+    TestFileCache();
+    TestHttpResponseRange();
+    TestHttpConditional();
+    TestHttpConnPipeline();
+    TestHttpConnTruncate();
+    TestIoUringPoller();
+    TestHeapTimer();
+    TestTimingWheel();
 }
\ No newline at end of file